@@ -0,0 +1,10 @@
+#ifndef __AT24C02_CRC16_H__
+#define __AT24C02_CRC16_H__
+
+#include <linux/types.h>
+#include <stddef.h>
+
+// 与驱动 AT24C02_CRC16 相同的 CRC-16/ARC (多项式 0x8005 反射, 初值 0)
+__u16 at24c02_crc16_arc(const void *buf, size_t len);
+
+#endif
@@ -12,7 +12,120 @@ struct at24c02_io_data {
   __u8 *buf;     // 指向用户空间数据缓冲区的指针
 };
 
+// 批量操作: 一次系统调用提交多个读/写请求
+#define AT24C02_OP_READ 0
+#define AT24C02_OP_WRITE 1
+// 单次批量请求的最大条目数
+#define AT24C02_BATCH_MAX 64
+
+struct at24c02_batch_entry {
+  __u8 op;         // AT24C02_OP_READ / AT24C02_OP_WRITE
+  __u8 reserved;   // 保留, 置 0
+  __u16 address;   // EEPROM 内部的起始地址
+  __u16 len;       // 读或写的字节数
+  __u16 reserved2; // 保留, 置 0
+  __s32 result;    // 输出: 0 表示成功, 否则为负的错误码
+  __u8 *buf;       // 指向用户空间数据缓冲区的指针
+};
+
+// 条目按提交顺序生效: 读条目看到它之前所有写条目的结果, 看不到之后的写入.
+// 驱动按页合并写条目, 把读条目排序合并成最少的顺序读;
+// 某个写条目覆盖之前的读条目时, 在该处分阶段执行.
+// 返回 0 表示全部成功, 正数表示失败的条目个数 (具体见各条目 result)
+struct at24c02_batch {
+  __u32 count;                         // 条目个数, 不超过 AT24C02_BATCH_MAX
+  struct at24c02_batch_entry *entries; // 条目数组
+};
+
+// 芯片参数, 由 AT24C02_GET_INFO 读取
+struct at24c02_info {
+  __u32 size;      // 容量 (字节)
+  __u16 page_size; // 页大小 (字节)
+  __u8 addr_width; // 字地址字节数, 1 或 2
+  __u8 reserved;
+};
+
+// 写入统计, 由 AT24C02_GET_STATS 读取
+struct at24c02_stats {
+  __u64 pages_written; // 实际执行的页写次数
+  __u64 pages_skipped; // 内容未变化而跳过的页数
+  __u64 bytes_skipped; // 内容未变化而未写入的字节数
+};
+
+// 校验算法
+#define AT24C02_CRC32 0 // CRC-32 (IEEE 802.3), 与 zlib crc32() 一致
+#define AT24C02_CRC16 1 // CRC-16/ARC (多项式 0x8005 反射, 初值 0)
+// AT24C02_CRC 的 flags: 与 expected 比较, 不一致时返回 -EBADMSG
+#define AT24C02_CRC_F_COMPARE 0x01
+// AT24C02_CRC 的 flags: 不使用影子缓存, 从芯片读出后计算 (用于写后校验)
+#define AT24C02_CRC_F_NOCACHE 0x02
+
+// 在驱动内计算区间校验值, 只把结果返回用户空间
+struct at24c02_crc_data {
+  __u16 address;  // EEPROM 内部的起始地址
+  __u16 len;      // 参与计算的字节数
+  __u8 type;      // AT24C02_CRC32 / AT24C02_CRC16
+  __u8 flags;     // AT24C02_CRC_F_*
+  __u16 reserved; // 保留, 置 0
+  __u32 expected; // 输入: 期望的校验值
+  __u32 crc;      // 输出: 计算得到的校验值
+};
+
+// 写入数据并在其后追加小端序校验值 (CRC32 4 字节 / CRC16 2 字节), 写后读回校验
+struct at24c02_crc_write {
+  __u16 address;   // EEPROM 内部的起始地址
+  __u16 len;       // 数据字节数, 不含校验值
+  __u8 type;       // AT24C02_CRC32 / AT24C02_CRC16
+  __u8 reserved[3]; // 保留, 置 0
+  __u8 *buf;       // 指向用户空间数据缓冲区的指针
+};
+
+// 原子读-改-写, 均在设备锁内完成, 只写入发生变化的页
+// 比较并交换: 当前内容等于 expected 时写入 desired,
+// 否则把当前内容写回 expected 并返回 -EAGAIN
+struct at24c02_cmpxchg {
+  __u16 address;  // EEPROM 内部的起始地址
+  __u16 len;      // 比较/写入的字节数
+  __u8 *expected; // 期望的当前内容 (失败时输出实际内容)
+  __u8 *desired;  // 要写入的新内容
+};
+
+// 位操作: new = (old & ~clear) | set
+struct at24c02_bitops {
+  __u16 address;    // EEPROM 内部地址
+  __u8 set;         // 要置位的位
+  __u8 clear;       // 要清零的位
+  __u8 old;         // 输出: 修改前的值
+  __u8 reserved[3]; // 保留, 置 0
+};
+
+// 小端计数器加法, 按宽度回绕
+struct at24c02_add {
+  __u16 address;    // EEPROM 内部地址
+  __u8 width;       // 计数器宽度: 1/2/4/8 字节
+  __u8 reserved[5]; // 保留, 置 0
+  __s64 delta;      // 增量, 可为负
+  __u64 old;        // 输出: 修改前的值
+};
+
 #define AT24C02_RANDOM_READ _IOWR(AT24C02_MAGIC, 1, struct at24c02_io_data)
 #define AT24C02_BYTE_WRITE _IOW(AT24C02_MAGIC, 2, struct at24c02_io_data)
+#define AT24C02_BATCH _IOWR(AT24C02_MAGIC, 3, struct at24c02_batch)
+// 与 AT24C02_BYTE_WRITE 相同, 但先与芯片当前内容比较, 只写入发生变化的页
+#define AT24C02_UPDATE _IOW(AT24C02_MAGIC, 4, struct at24c02_io_data)
+#define AT24C02_GET_STATS _IOR(AT24C02_MAGIC, 5, struct at24c02_stats)
+#define AT24C02_GET_INFO _IOR(AT24C02_MAGIC, 6, struct at24c02_info)
+// 异步写: 数据进入内核队列后立即返回, 完成前对读不可见
+// 队列满时阻塞, O_NONBLOCK 下返回 -EAGAIN
+#define AT24C02_WRITE_ASYNC _IOW(AT24C02_MAGIC, 7, struct at24c02_io_data)
+// 等待全部异步写完成, 返回并清除此前的第一个错误
+#define AT24C02_SYNC _IO(AT24C02_MAGIC, 8)
+// 注册 eventfd, 异步写队列排空或出错时计数加一; 传入 -1 取消
+#define AT24C02_SET_EVENTFD _IOW(AT24C02_MAGIC, 9, int)
+#define AT24C02_CRC _IOWR(AT24C02_MAGIC, 10, struct at24c02_crc_data)
+#define AT24C02_WRITE_CRC _IOW(AT24C02_MAGIC, 11, struct at24c02_crc_write)
+#define AT24C02_CMPXCHG _IOW(AT24C02_MAGIC, 12, struct at24c02_cmpxchg)
+#define AT24C02_BITOPS _IOWR(AT24C02_MAGIC, 13, struct at24c02_bitops)
+#define AT24C02_ADD _IOWR(AT24C02_MAGIC, 14, struct at24c02_add)
 
 #endif
\ No newline at end of file
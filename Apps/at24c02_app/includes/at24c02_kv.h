@@ -0,0 +1,59 @@
+#ifndef __AT24C02_KV_H__
+#define __AT24C02_KV_H__
+
+#include <linux/types.h>
+#include <stddef.h>
+
+/*
+ * 日志结构的键值存储
+ *
+ * 存储区是一个环形日志, 每次 put/del 都在头部追加一条页对齐的记录:
+ *   [seq:4][tail:2][key_len:1][val_len:1][key][value][crc16:2][填充到整页]
+ * tail 是写入该记录时日志尾的位置, 打开时只需找出 seq 最新的记录,
+ * 再从它记录的 tail 顺序回放到它为止, 就能在内存中重建索引.
+ * 写入位置随环形日志轮转, 擦写次数分摊到整个存储区.
+ * 空间不足时从日志尾回收: 已被覆盖的旧记录直接丢弃, 仍有效的记录重新追加到头部.
+ * 记录写一半掉电时 CRC 不通过, 打开时被忽略, 之前的状态保持不变.
+ */
+
+#define AT24C02_KV_KEY_MAX 16 // 键的最大长度 (字节)
+#define AT24C02_KV_VAL_MAX 32 // 值的最大长度 (字节)
+#define AT24C02_KV_SLOTS 128  // 内存索引的槽数, 2 的幂, 键数不超过其 3/4
+#define AT24C02_KV_MAGIC 0xa55a
+#define AT24C02_KV_HDR_LEN 8
+
+// 内存索引: 键和值都缓存在内存中, get 不访问总线
+struct at24c02_kv_entry {
+  __u8 state;   // 0 空, 1 使用中, 2 已删除
+  __u8 key_len;
+  __u8 val_len;
+  __u32 offset; // 记录在存储区内的偏移
+  __u8 key[AT24C02_KV_KEY_MAX];
+  __u8 val[AT24C02_KV_VAL_MAX];
+};
+
+struct at24c02_kv {
+  int fd;          // 已打开的设备节点
+  __u16 base;      // 存储区起始地址, 页对齐
+  __u32 size;      // 存储区字节数, 页对齐
+  __u16 page_size; // 芯片页大小
+  __u32 head;      // 下一条记录的偏移
+  __u32 tail;      // 日志尾, 之前的空间已回收
+  __u32 ptail;     // 最近一条写入成功的记录中保存的 tail, 此前的空间才能覆盖
+  __u32 seq;       // 下一条记录的序号
+  __u32 live;      // 有效记录占用的字节数
+  __u32 keys;      // 有效键的个数
+  struct at24c02_kv_entry table[AT24C02_KV_SLOTS];
+};
+
+// 在 [base, base + size) 上打开键值存储, 顺序读一遍存储区重建索引
+int at24c02_kv_open(struct at24c02_kv *kv, int fd, __u16 base, __u32 size);
+// 返回值的长度, 键不存在返回 -ENOENT, 缓冲区不足返回 -ENOSPC
+int at24c02_kv_get(struct at24c02_kv *kv, const char *key, void *buf,
+                   size_t len);
+// 值与当前相同时不写入
+int at24c02_kv_put(struct at24c02_kv *kv, const char *key, const void *val,
+                   size_t len);
+int at24c02_kv_del(struct at24c02_kv *kv, const char *key);
+
+#endif
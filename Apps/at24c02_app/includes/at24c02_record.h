@@ -0,0 +1,47 @@
+#ifndef __AT24C02_RECORD_H__
+#define __AT24C02_RECORD_H__
+
+#include <linux/types.h>
+#include <stddef.h>
+
+/*
+ * 掉电安全的 A/B 双槽记录存储
+ *
+ * 存储区平分为两个槽, 每个槽的第一页是头部, 其后是数据:
+ *   [头部页][数据 ...]
+ * 提交新版本时先把数据写入非当前槽并在驱动内校验, 最后单独写头部页.
+ * 页写在芯片内部是原子的, 断电只会损坏尚未提交的槽, 另一个槽保持有效.
+ * 启动时只读两个头部, 数据校验由 AT24C02_CRC 在驱动内完成, 无需全片扫描.
+ */
+
+// 头部固定 8 字节, 放得进最小的页 (AT24C02 页大小为 8)
+struct at24c02_rec_header {
+  __u16 seq;      // 序号, 回绕比较, 较新的槽胜出
+  __u16 len;      // 数据字节数
+  __u16 data_crc; // 数据的 CRC-16/ARC
+  __u16 hdr_crc;  // 前 6 字节的 CRC-16/ARC 异或 AT24C02_REC_MAGIC
+};
+
+// 全 0 或全 0xFF 的空白槽不会通过头部校验
+#define AT24C02_REC_MAGIC 0x5aa5
+
+struct at24c02_rec {
+  int fd;           // 已打开的设备节点
+  __u16 base;       // 存储区起始地址, 页对齐
+  __u16 slot_size;  // 每个槽的字节数, 页对齐
+  __u16 page_size;  // 芯片页大小
+  int active;       // 当前有效槽 0/1, -1 表示两个槽都无效
+  struct at24c02_rec_header hdr; // 当前有效槽的头部
+};
+
+// 在 [base, base + size) 上打开记录存储并选出最新的有效槽
+// 成功返回 0, 两个槽都无效时 active 为 -1; 失败返回负的错误码
+int at24c02_rec_open(struct at24c02_rec *rec, int fd, __u16 base, __u32 size);
+// 单条记录的最大长度
+size_t at24c02_rec_capacity(const struct at24c02_rec *rec);
+// 读出当前记录, 返回记录长度; 没有有效记录返回 -ENOENT, 缓冲区不足返回 -ENOSPC
+int at24c02_rec_read(struct at24c02_rec *rec, void *buf, size_t len);
+// 提交新版本, 返回后新记录即生效; 失败时原记录保持不变
+int at24c02_rec_write(struct at24c02_rec *rec, const void *buf, size_t len);
+
+#endif
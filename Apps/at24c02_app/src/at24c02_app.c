@@ -7,10 +7,12 @@
 #include <sys/types.h>
 #include <unistd.h>
 
-#define AT24C02_FILE_PATH "/dev/at24c02_device"
+// 设备节点以 总线号-从机地址 命名, 可通过第一个参数指定其他实例
+#define AT24C02_FILE_PATH "/dev/at24c02_0-0050"
 
 int main(int argc, char **argv) {
   int fd, ret;
+  const char *path = argc > 1 ? argv[1] : AT24C02_FILE_PATH;
   struct at24c02_io_data io_data;
   // AT24C02 的页大小是 8 字节。这意味着它在一次写操作中最多只能写入 8
   // 个字节。如果试图一次性写入超过 8 字节的数据，EEPROM
@@ -19,8 +21,8 @@ int main(int argc, char **argv) {
   char read_buf[30]; // 缓冲区大小要足够大
 
   // 1. 打开设备节点
-  printf("Opening device: at24c02_device\n");
-  fd = open(AT24C02_FILE_PATH, O_RDWR);
+  printf("Opening device: %s\n", path);
+  fd = open(path, O_RDWR);
   if (fd < 0) {
     perror("Failed to open the device\n");
     return -1;
@@ -0,0 +1,14 @@
+#include "at24c02_crc16.h"
+
+__u16 at24c02_crc16_arc(const void *buf, size_t len) {
+  const __u8 *p = buf;
+  __u16 crc = 0;
+  int i;
+
+  while (len--) {
+    crc ^= *p++;
+    for (i = 0; i < 8; i++)
+      crc = (crc & 1) ? (crc >> 1) ^ 0xa001 : crc >> 1;
+  }
+  return crc;
+}
@@ -0,0 +1,410 @@
+#include "at24c02_kv.h"
+#include "at24c02_crc16.h"
+#include "at24c02_header.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+
+// 删除记录的 val_len, 检查点记录的 key_len 为 0
+#define KV_TOMBSTONE 0xff
+#define KV_REC_MAX (AT24C02_KV_HDR_LEN + AT24C02_KV_KEY_MAX + AT24C02_KV_VAL_MAX + 2)
+#define KV_RESERVE(kv) kv_rec_len(kv, AT24C02_KV_KEY_MAX, AT24C02_KV_VAL_MAX)
+// 单次 ioctl 的长度字段是 16 位
+#define KV_IO_CHUNK 32768
+
+enum { KV_EMPTY, KV_USED, KV_DELETED };
+
+struct kv_rec {
+  __u32 seq;
+  __u32 tail;
+  __u8 key_len;
+  __u8 val_len; // 可能为 KV_TOMBSTONE
+  __u32 len;    // 含填充的记录长度
+  __u8 key[AT24C02_KV_KEY_MAX];
+  __u8 val[AT24C02_KV_VAL_MAX];
+};
+
+static __u32 kv_hash(const __u8 *key, size_t len) {
+  __u32 h = 2166136261u;
+
+  while (len--)
+    h = (h ^ *key++) * 16777619u;
+  return h;
+}
+
+static __u32 kv_dist(const struct at24c02_kv *kv, __u32 from, __u32 to) {
+  return (to + kv->size - from) % kv->size;
+}
+
+static __u32 kv_rec_len(const struct at24c02_kv *kv, size_t key_len,
+                        size_t val_len) {
+  __u32 len = AT24C02_KV_HDR_LEN + key_len + val_len + 2;
+
+  return (len + kv->page_size - 1) / kv->page_size * kv->page_size;
+}
+
+// 可以直接覆盖的空间, 始终留一页使 head == ptail 只表示空
+static __u32 kv_free(const struct at24c02_kv *kv) {
+  return kv->size - kv_dist(kv, kv->ptail, kv->head) - kv->page_size;
+}
+
+// 环形读写: 跨过存储区末尾时拆成两段
+static int kv_io(struct at24c02_kv *kv, unsigned long cmd, __u32 off,
+                 __u8 *buf, __u32 len) {
+  struct at24c02_io_data io;
+  __u32 count;
+
+  while (len) {
+    count = kv->size - off;
+    if (count > len)
+      count = len;
+    if (count > KV_IO_CHUNK)
+      count = KV_IO_CHUNK;
+    io.address = kv->base + off;
+    io.len = count;
+    io.buf = buf;
+    if (ioctl(kv->fd, cmd, &io) < 0)
+      return -errno;
+    off = (off + count) % kv->size;
+    buf += count;
+    len -= count;
+  }
+  return 0;
+}
+
+static struct at24c02_kv_entry *kv_find(struct at24c02_kv *kv,
+                                        const __u8 *key, size_t len) {
+  __u32 i, idx = kv_hash(key, len);
+  struct at24c02_kv_entry *ent;
+
+  for (i = 0; i < AT24C02_KV_SLOTS; i++) {
+    ent = &kv->table[(idx + i) % AT24C02_KV_SLOTS];
+    if (ent->state == KV_EMPTY)
+      return NULL;
+    if (ent->state == KV_USED && ent->key_len == len &&
+        !memcmp(ent->key, key, len))
+      return ent;
+  }
+  return NULL;
+}
+
+static struct at24c02_kv_entry *kv_insert(struct at24c02_kv *kv,
+                                          const __u8 *key, size_t len) {
+  __u32 i, idx = kv_hash(key, len);
+  struct at24c02_kv_entry *ent = kv_find(kv, key, len);
+
+  if (ent)
+    return ent;
+  for (i = 0; i < AT24C02_KV_SLOTS; i++) {
+    ent = &kv->table[(idx + i) % AT24C02_KV_SLOTS];
+    if (ent->state != KV_USED) {
+      ent->state = KV_USED;
+      ent->key_len = len;
+      memcpy(ent->key, key, len);
+      kv->keys++;
+      return ent;
+    }
+  }
+  return NULL;
+}
+
+static void kv_remove(struct at24c02_kv *kv, struct at24c02_kv_entry *ent) {
+  kv->live -= kv_rec_len(kv, ent->key_len, ent->val_len);
+  kv->keys--;
+  ent->state = KV_DELETED;
+}
+
+// 把一条记录反映到索引中, 打开时按日志顺序调用
+static void kv_apply(struct at24c02_kv *kv, const struct kv_rec *rec,
+                     __u32 off) {
+  struct at24c02_kv_entry *ent;
+
+  if (!rec->key_len)
+    return;
+  ent = kv_find(kv, rec->key, rec->key_len);
+  if (ent)
+    kv_remove(kv, ent);
+  if (rec->val_len == KV_TOMBSTONE)
+    return;
+  ent = kv_insert(kv, rec->key, rec->key_len);
+  if (!ent)
+    return;
+  ent->val_len = rec->val_len;
+  ent->offset = off;
+  memcpy(ent->val, rec->val, rec->val_len);
+  kv->live += rec->len;
+}
+
+// 从存储区映像中解析一条记录, 不合法返回 -EBADMSG
+static int kv_parse(const struct at24c02_kv *kv, const __u8 *img, __u32 off,
+                    struct kv_rec *rec) {
+  __u8 raw[KV_REC_MAX];
+  __u32 i, val_len, n;
+
+  for (i = 0; i < AT24C02_KV_HDR_LEN; i++)
+    raw[i] = img[(off + i) % kv->size];
+  rec->seq = raw[0] | raw[1] << 8 | raw[2] << 16 | (__u32)raw[3] << 24;
+  rec->tail = raw[4] | raw[5] << 8;
+  rec->key_len = raw[6];
+  rec->val_len = raw[7];
+  val_len = rec->val_len == KV_TOMBSTONE ? 0 : rec->val_len;
+  if (rec->key_len > AT24C02_KV_KEY_MAX || val_len > AT24C02_KV_VAL_MAX ||
+      rec->tail >= kv->size || rec->tail % kv->page_size)
+    return -EBADMSG;
+  rec->len = kv_rec_len(kv, rec->key_len, val_len);
+  if (rec->len >= kv->size)
+    return -EBADMSG;
+
+  n = AT24C02_KV_HDR_LEN + rec->key_len + val_len;
+  for (; i < n + 2; i++)
+    raw[i] = img[(off + i) % kv->size];
+  if ((at24c02_crc16_arc(raw, n) ^ AT24C02_KV_MAGIC) != (raw[n] | raw[n + 1] << 8))
+    return -EBADMSG;
+  memcpy(rec->key, raw + AT24C02_KV_HDR_LEN, rec->key_len);
+  memcpy(rec->val, raw + AT24C02_KV_HDR_LEN + rec->key_len, val_len);
+  return 0;
+}
+
+// 在头部追加一条记录, 并把 tail 持久化; 成功后返回记录偏移
+static int kv_append(struct at24c02_kv *kv, const __u8 *key, size_t key_len,
+                     const __u8 *val, __u8 val_len, __u32 *offset) {
+  __u8 raw[KV_REC_MAX + 256]; // 填充不超过一页, 页大小不超过 256
+  __u32 n, len, vlen = val_len == KV_TOMBSTONE ? 0 : val_len;
+  __u16 crc;
+  int ret;
+
+  len = kv_rec_len(kv, key_len, vlen);
+  if (len > sizeof(raw) || len > kv_free(kv))
+    return -ENOSPC;
+
+  // 填充部分写 0xFF, 与擦除后的内容一致
+  memset(raw, 0xff, len);
+  raw[0] = kv->seq & 0xff;
+  raw[1] = kv->seq >> 8;
+  raw[2] = kv->seq >> 16;
+  raw[3] = kv->seq >> 24;
+  raw[4] = kv->tail & 0xff;
+  raw[5] = kv->tail >> 8;
+  raw[6] = key_len;
+  raw[7] = val_len;
+  if (key_len)
+    memcpy(raw + AT24C02_KV_HDR_LEN, key, key_len);
+  if (vlen)
+    memcpy(raw + AT24C02_KV_HDR_LEN + key_len, val, vlen);
+  n = AT24C02_KV_HDR_LEN + key_len + vlen;
+  crc = at24c02_crc16_arc(raw, n) ^ AT24C02_KV_MAGIC;
+  raw[n] = crc & 0xff;
+  raw[n + 1] = crc >> 8;
+
+  ret = kv_io(kv, AT24C02_BYTE_WRITE, kv->head, raw, len);
+  if (ret)
+    return ret;
+  if (offset)
+    *offset = kv->head;
+  kv->head = (kv->head + len) % kv->size;
+  kv->ptail = kv->tail;
+  kv->seq++;
+  return 0;
+}
+
+/*
+ * 回收日志尾直到可覆盖空间不少于 need 加一条最大记录.
+ * 预留一条最大记录保证搬移任何一条有效记录时都有空间.
+ * 被丢弃的旧记录在新 tail 写入成功前仍可能被打开时回放, 所以 ptail 之前的空间不能覆盖;
+ * 日志尾已经追上头部时写一条一页的检查点记录来持久化 tail.
+ * old 是将被 upd 取代的记录: 日志尾走到它时不再搬移旧值, 而是直接追加 upd,
+ * 同一次写入既提交更新又持久化越过旧记录的 tail, 此时更新索引并返回 1.
+ * 因此旧记录占用的空间可以算作已释放, 回收不会在空间刚好够时空转.
+ * 提交之后的回收只是恢复余量, 失败时仍返回 1, 留给下一次操作继续回收.
+ */
+static int kv_reclaim(struct at24c02_kv *kv, __u32 need,
+                      struct at24c02_kv_entry *old, struct kv_rec *upd) {
+  struct at24c02_kv_entry *ent;
+  struct kv_rec rec;
+  __u8 hdr[AT24C02_KV_HDR_LEN + AT24C02_KV_KEY_MAX];
+  __u32 off, offset;
+  int ret, done = 0;
+
+  while (kv_free(kv) < (done ? 0 : need) + KV_RESERVE(kv)) {
+    if (kv->tail == kv->head) {
+      ret = kv_append(kv, NULL, 0, NULL, 0, NULL);
+      if (ret)
+        return done ? 1 : ret;
+      continue;
+    }
+
+    ret = kv_io(kv, AT24C02_RANDOM_READ, kv->tail, hdr, sizeof(hdr));
+    if (ret)
+      return done ? 1 : ret;
+    rec.key_len = hdr[6] <= AT24C02_KV_KEY_MAX ? hdr[6] : 0;
+    rec.val_len = hdr[7];
+    ent = rec.key_len ? kv_find(kv, hdr + AT24C02_KV_HDR_LEN, rec.key_len)
+                      : NULL;
+    off = kv->tail;
+    kv->tail = (kv->tail + kv_rec_len(kv, rec.key_len,
+                                      rec.val_len == KV_TOMBSTONE
+                                          ? 0
+                                          : rec.val_len)) %
+               kv->size;
+    if (!ent || ent->offset != off)
+      continue;
+
+    // 追加后仍要留有一条最大记录的余量, 否则照常搬移, 等日志更紧凑后再轮到它
+    if (ent == old && !done &&
+        kv->size - kv->page_size - kv_dist(kv, kv->tail, kv->head) >=
+            upd->len + KV_RESERVE(kv)) {
+      ret = kv_append(kv, upd->key, upd->key_len, upd->val, upd->val_len,
+                      &offset);
+      if (ret) {
+        kv->tail = off;
+        return ret;
+      }
+      kv_apply(kv, upd, offset);
+      done = 1;
+      continue;
+    }
+
+    // 仍有效的记录搬到头部, 同时持久化新的 tail
+    ret = kv_append(kv, ent->key, ent->key_len, ent->val, ent->val_len,
+                    &ent->offset);
+    if (ret) {
+      kv->tail = off;
+      return done ? 1 : ret;
+    }
+  }
+  return done;
+}
+
+/*
+ * 以 upd 取代 ent (新键时为 NULL) 并写入日志.
+ * spare 是除 upd 之外还需保留的空间: 新键要为将来删除它的墓碑留出余量.
+ */
+static int kv_update(struct at24c02_kv *kv, struct at24c02_kv_entry *ent,
+                     struct kv_rec *upd, __u32 spare) {
+  __u32 live = kv->live, offset;
+  int ret;
+
+  // 1. 被取代的记录不再有效, 新的有效数据加预留必须能放下, 否则回收也腾不出空间
+  if (ent)
+    live -= kv_rec_len(kv, ent->key_len, ent->val_len);
+  if (live + upd->len + spare + KV_RESERVE(kv) + 2 * kv->page_size > kv->size)
+    return -ENOSPC;
+  ret = kv_reclaim(kv, upd->len, ent, upd);
+  if (ret)
+    return ret < 0 ? ret : 0;
+
+  // 2. 追加记录, 成功后再更新索引
+  ret = kv_append(kv, upd->key, upd->key_len, upd->val, upd->val_len, &offset);
+  if (ret)
+    return ret;
+  kv_apply(kv, upd, offset);
+  return 0;
+}
+
+int at24c02_kv_open(struct at24c02_kv *kv, int fd, __u16 base, __u32 size) {
+  struct at24c02_info info;
+  struct kv_rec rec, newest = {0};
+  __u32 off, walked;
+  __u8 *img;
+  int found = 0, ret;
+
+  // 1. 检查存储区是否页对齐并能放下最大记录和预留空间
+  if (ioctl(fd, AT24C02_GET_INFO, &info) < 0)
+    return -errno;
+  if (base % info.page_size || size % info.page_size ||
+      (__u32)base + size > info.size)
+    return -EINVAL;
+  memset(kv, 0, sizeof(*kv));
+  kv->fd = fd;
+  kv->base = base;
+  kv->size = size;
+  kv->page_size = info.page_size;
+  if (size < 2 * KV_RESERVE(kv) + 2 * kv->page_size)
+    return -EINVAL;
+
+  // 2. 一次顺序读出整个存储区
+  img = malloc(size);
+  if (!img)
+    return -ENOMEM;
+  ret = kv_io(kv, AT24C02_RANDOM_READ, 0, img, size);
+  if (ret)
+    goto out;
+
+  // 3. 在每个页边界上找 seq 最新的合法记录
+  for (off = 0; off < size; off += kv->page_size) {
+    if (kv_parse(kv, img, off, &rec))
+      continue;
+    if (!found || (__s32)(rec.seq - newest.seq) > 0) {
+      newest = rec;
+      kv->head = (off + rec.len) % size;
+      found = 1;
+    }
+  }
+  if (!found)
+    goto out;
+
+  // 4. 从最新记录保存的 tail 回放到头部, 重建索引
+  kv->tail = kv->ptail = newest.tail;
+  kv->seq = newest.seq + 1;
+  for (off = kv->tail, walked = 0; off != kv->head; off = (off + rec.len) % size) {
+    if (kv_parse(kv, img, off, &rec) || (walked += rec.len) > size) {
+      ret = -EBADMSG;
+      goto out;
+    }
+    kv_apply(kv, &rec, off);
+  }
+
+out:
+  free(img);
+  return ret;
+}
+
+int at24c02_kv_get(struct at24c02_kv *kv, const char *key, void *buf,
+                   size_t len) {
+  struct at24c02_kv_entry *ent = kv_find(kv, (const __u8 *)key, strlen(key));
+
+  if (!ent)
+    return -ENOENT;
+  if (len < ent->val_len)
+    return -ENOSPC;
+  memcpy(buf, ent->val, ent->val_len);
+  return ent->val_len;
+}
+
+int at24c02_kv_put(struct at24c02_kv *kv, const char *key, const void *val,
+                   size_t len) {
+  size_t key_len = strlen(key);
+  struct at24c02_kv_entry *ent;
+  struct kv_rec upd;
+
+  if (!key_len || key_len > AT24C02_KV_KEY_MAX || len > AT24C02_KV_VAL_MAX)
+    return -EINVAL;
+  ent = kv_find(kv, (const __u8 *)key, key_len);
+  if (ent && ent->val_len == len && !memcmp(ent->val, val, len))
+    return 0;
+  if (!ent && kv->keys >= AT24C02_KV_SLOTS * 3 / 4)
+    return -ENOSPC;
+
+  upd.key_len = key_len;
+  upd.val_len = len;
+  upd.len = kv_rec_len(kv, key_len, len);
+  memcpy(upd.key, key, key_len);
+  if (len)
+    memcpy(upd.val, val, len);
+  return kv_update(kv, ent, &upd, ent ? 0 : kv_rec_len(kv, key_len, 0));
+}
+
+int at24c02_kv_del(struct at24c02_kv *kv, const char *key) {
+  size_t key_len = strlen(key);
+  struct at24c02_kv_entry *ent = kv_find(kv, (const __u8 *)key, key_len);
+  struct kv_rec upd;
+
+  if (!ent)
+    return -ENOENT;
+  upd.key_len = key_len;
+  upd.val_len = KV_TOMBSTONE;
+  upd.len = kv_rec_len(kv, key_len, 0);
+  memcpy(upd.key, key, key_len);
+  return kv_update(kv, ent, &upd, 0);
+}
@@ -0,0 +1,164 @@
+#include "at24c02_record.h"
+#include "at24c02_crc16.h"
+#include "at24c02_header.h"
+#include <errno.h>
+#include <string.h>
+#include <sys/ioctl.h>
+
+// 头部按小端序存放, 与主机字节序无关
+static void hdr_pack(const struct at24c02_rec_header *hdr, __u8 raw[8]) {
+  raw[0] = hdr->seq & 0xff;
+  raw[1] = hdr->seq >> 8;
+  raw[2] = hdr->len & 0xff;
+  raw[3] = hdr->len >> 8;
+  raw[4] = hdr->data_crc & 0xff;
+  raw[5] = hdr->data_crc >> 8;
+  raw[6] = hdr->hdr_crc & 0xff;
+  raw[7] = hdr->hdr_crc >> 8;
+}
+
+static void hdr_unpack(struct at24c02_rec_header *hdr, const __u8 raw[8]) {
+  hdr->seq = raw[0] | raw[1] << 8;
+  hdr->len = raw[2] | raw[3] << 8;
+  hdr->data_crc = raw[4] | raw[5] << 8;
+  hdr->hdr_crc = raw[6] | raw[7] << 8;
+}
+
+static __u16 slot_addr(const struct at24c02_rec *rec, int slot) {
+  return rec->base + slot * rec->slot_size;
+}
+
+// 读取并校验一个槽: 头部 CRC 在用户空间计算, 数据 CRC 交给驱动比较
+static int slot_load(struct at24c02_rec *rec, int slot,
+                     struct at24c02_rec_header *hdr) {
+  struct at24c02_io_data io;
+  struct at24c02_crc_data crc;
+  __u8 raw[8];
+
+  io.address = slot_addr(rec, slot);
+  io.len = sizeof(raw);
+  io.buf = raw;
+  if (ioctl(rec->fd, AT24C02_RANDOM_READ, &io) < 0)
+    return -errno;
+  hdr_unpack(hdr, raw);
+  if ((at24c02_crc16_arc(raw, 6) ^ AT24C02_REC_MAGIC) != hdr->hdr_crc ||
+      hdr->len > at24c02_rec_capacity(rec))
+    return -EBADMSG;
+  if (!hdr->len)
+    return 0;
+
+  memset(&crc, 0, sizeof(crc));
+  crc.address = slot_addr(rec, slot) + rec->page_size;
+  crc.len = hdr->len;
+  crc.type = AT24C02_CRC16;
+  crc.flags = AT24C02_CRC_F_COMPARE;
+  crc.expected = hdr->data_crc;
+  if (ioctl(rec->fd, AT24C02_CRC, &crc) < 0)
+    return -errno;
+  return 0;
+}
+
+int at24c02_rec_open(struct at24c02_rec *rec, int fd, __u16 base, __u32 size) {
+  struct at24c02_info info;
+  struct at24c02_rec_header hdr[2];
+  int ret[2];
+  int slot;
+
+  // 1. 按芯片页大小划分两个页对齐的槽
+  if (ioctl(fd, AT24C02_GET_INFO, &info) < 0)
+    return -errno;
+  if (info.page_size < sizeof(hdr[0]) || base % info.page_size ||
+      (__u32)base + size > info.size)
+    return -EINVAL;
+  rec->fd = fd;
+  rec->base = base;
+  rec->page_size = info.page_size;
+  rec->slot_size = size / 2 / info.page_size * info.page_size;
+  rec->active = -1;
+  if (rec->slot_size < 2 * info.page_size)
+    return -EINVAL;
+
+  // 2. 只读两个头部, 选出序号较新的有效槽
+  for (slot = 0; slot < 2; slot++) {
+    ret[slot] = slot_load(rec, slot, &hdr[slot]);
+    if (ret[slot] && ret[slot] != -EBADMSG)
+      return ret[slot];
+  }
+  if (!ret[0] && !ret[1])
+    rec->active = (__s16)(hdr[1].seq - hdr[0].seq) > 0;
+  else if (!ret[0] || !ret[1])
+    rec->active = ret[0] ? 1 : 0;
+  if (rec->active >= 0)
+    rec->hdr = hdr[rec->active];
+  return 0;
+}
+
+size_t at24c02_rec_capacity(const struct at24c02_rec *rec) {
+  return rec->slot_size - rec->page_size;
+}
+
+int at24c02_rec_read(struct at24c02_rec *rec, void *buf, size_t len) {
+  struct at24c02_io_data io;
+
+  if (rec->active < 0)
+    return -ENOENT;
+  if (len < rec->hdr.len)
+    return -ENOSPC;
+  if (!rec->hdr.len)
+    return 0;
+
+  io.address = slot_addr(rec, rec->active) + rec->page_size;
+  io.len = rec->hdr.len;
+  io.buf = buf;
+  if (ioctl(rec->fd, AT24C02_RANDOM_READ, &io) < 0)
+    return -errno;
+  return rec->hdr.len;
+}
+
+int at24c02_rec_write(struct at24c02_rec *rec, const void *buf, size_t len) {
+  struct at24c02_rec_header hdr;
+  struct at24c02_io_data io;
+  struct at24c02_crc_data crc;
+  __u8 raw[8];
+  int slot = rec->active == 0 ? 1 : 0;
+
+  if (len > at24c02_rec_capacity(rec))
+    return -ENOSPC;
+
+  // 1. 数据写入非当前槽, UPDATE 跳过内容未变化的页以减少磨损
+  hdr.seq = rec->active < 0 ? 0 : rec->hdr.seq + 1;
+  hdr.len = len;
+  hdr.data_crc = at24c02_crc16_arc(buf, len);
+  if (len) {
+    io.address = slot_addr(rec, slot) + rec->page_size;
+    io.len = len;
+    io.buf = (__u8 *)buf;
+    if (ioctl(rec->fd, AT24C02_UPDATE, &io) < 0)
+      return -errno;
+
+    // 2. 提交前绕过驱动缓存从芯片读回校验, 确认数据已完整落盘
+    memset(&crc, 0, sizeof(crc));
+    crc.address = io.address;
+    crc.len = len;
+    crc.type = AT24C02_CRC16;
+    crc.flags = AT24C02_CRC_F_COMPARE | AT24C02_CRC_F_NOCACHE;
+    crc.expected = hdr.data_crc;
+    if (ioctl(rec->fd, AT24C02_CRC, &crc) < 0)
+      return -errno;
+  }
+
+  // 3. 最后写头部页, 这一次页写就是提交点
+  hdr.hdr_crc = 0;
+  hdr_pack(&hdr, raw);
+  hdr.hdr_crc = at24c02_crc16_arc(raw, 6) ^ AT24C02_REC_MAGIC;
+  hdr_pack(&hdr, raw);
+  io.address = slot_addr(rec, slot);
+  io.len = sizeof(raw);
+  io.buf = raw;
+  if (ioctl(rec->fd, AT24C02_BYTE_WRITE, &io) < 0)
+    return -errno;
+
+  rec->active = slot;
+  rec->hdr = hdr;
+  return 0;
+}
@@ -0,0 +1,312 @@
+/*
+ * 记录存储和键值存储的主机端测试
+ *
+ * 用内存中的模拟芯片替换驱动: 本文件定义的 ioctl() 覆盖 C 库中的同名函数,
+ * 按页执行写入, 并可在写完指定页数后模拟掉电 (之后的页写全部失败),
+ * 以此验证写一半掉电后重新打开, 读到的要么是旧内容要么是新内容.
+ */
+#include "at24c02_crc16.h"
+#include "at24c02_header.h"
+#include "at24c02_kv.h"
+#include "at24c02_record.h"
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+
+#define CHIP_SIZE 4096
+#define CHIP_PAGE 32
+#define TEST_FD 3
+
+static __u8 chip[CHIP_SIZE];
+// 掉电前还能完成的页写次数, -1 表示不限
+static long page_budget = -1;
+static int failures;
+
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      printf("%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond);          \
+      failures++;                                                              \
+      return;                                                                  \
+    }                                                                          \
+  } while (0)
+
+static int chip_io(struct at24c02_io_data *io, int write) {
+  __u32 off = io->address, len = io->len, count;
+  __u8 *buf = io->buf;
+
+  if (off + len > CHIP_SIZE) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (!write) {
+    memcpy(buf, chip + off, len);
+    return 0;
+  }
+  while (len) {
+    count = CHIP_PAGE - off % CHIP_PAGE;
+    if (count > len)
+      count = len;
+    if (!page_budget) {
+      errno = EIO;
+      return -1;
+    }
+    if (page_budget > 0)
+      page_budget--;
+    memcpy(chip + off, buf, count);
+    off += count;
+    buf += count;
+    len -= count;
+  }
+  return 0;
+}
+
+int ioctl(int fd, unsigned long cmd, ...) {
+  struct at24c02_info *info;
+  struct at24c02_crc_data *crc;
+  va_list ap;
+  void *arg;
+
+  va_start(ap, cmd);
+  arg = va_arg(ap, void *);
+  va_end(ap);
+  if (fd != TEST_FD) {
+    errno = EBADF;
+    return -1;
+  }
+
+  switch (cmd) {
+  case AT24C02_GET_INFO:
+    info = arg;
+    memset(info, 0, sizeof(*info));
+    info->size = CHIP_SIZE;
+    info->page_size = CHIP_PAGE;
+    info->addr_width = 2;
+    return 0;
+  case AT24C02_RANDOM_READ:
+    return chip_io(arg, 0);
+  case AT24C02_BYTE_WRITE:
+  case AT24C02_UPDATE:
+    return chip_io(arg, 1);
+  case AT24C02_CRC:
+    crc = arg;
+    if (crc->address + crc->len > CHIP_SIZE || crc->type != AT24C02_CRC16) {
+      errno = EINVAL;
+      return -1;
+    }
+    crc->crc = at24c02_crc16_arc(chip + crc->address, crc->len);
+    if ((crc->flags & AT24C02_CRC_F_COMPARE) && crc->crc != crc->expected) {
+      errno = EBADMSG;
+      return -1;
+    }
+    return 0;
+  default:
+    errno = ENOTTY;
+    return -1;
+  }
+}
+
+static void fill(__u8 *buf, size_t len, unsigned int seed) {
+  size_t i;
+
+  for (i = 0; i < len; i++)
+    buf[i] = (__u8)(seed * 131 + i * 7);
+}
+
+// 打开, 写入, 重新打开, 读回
+static void test_rec_basic(void) {
+  struct at24c02_rec rec;
+  __u8 buf[256], got[256];
+  int ret;
+
+  memset(chip, 0xff, sizeof(chip));
+  CHECK(at24c02_rec_open(&rec, TEST_FD, 0, 1024) == 0);
+  CHECK(rec.active == -1);
+  CHECK(at24c02_rec_read(&rec, got, sizeof(got)) == -ENOENT);
+
+  fill(buf, sizeof(buf), 1);
+  CHECK(at24c02_rec_write(&rec, buf, sizeof(buf)) == 0);
+  CHECK(at24c02_rec_write(&rec, buf, 100) == 0);
+
+  memset(&rec, 0, sizeof(rec));
+  CHECK(at24c02_rec_open(&rec, TEST_FD, 0, 1024) == 0);
+  ret = at24c02_rec_read(&rec, got, sizeof(got));
+  CHECK(ret == 100 && !memcmp(got, buf, 100));
+}
+
+// 每次写入在第 n 次页写后掉电, 重新打开后必须读到旧记录或新记录
+static void test_rec_torn(void) {
+  struct at24c02_rec rec;
+  __u8 cur[512], buf[512], got[512];
+  size_t cur_len, len;
+  long n;
+  int ret, wret, i;
+
+  memset(chip, 0xff, sizeof(chip));
+  CHECK(at24c02_rec_open(&rec, TEST_FD, 0, 1024) == 0);
+  cur_len = 40;
+  fill(cur, cur_len, 0);
+  CHECK(at24c02_rec_write(&rec, cur, cur_len) == 0);
+
+  for (i = 1; i < 200; i++) {
+    len = (i * 37) % (at24c02_rec_capacity(&rec) + 1);
+    fill(buf, len, i);
+    for (n = 0;; n++) {
+      page_budget = n;
+      wret = at24c02_rec_write(&rec, buf, len);
+      page_budget = -1;
+
+      memset(&rec, 0, sizeof(rec));
+      CHECK(at24c02_rec_open(&rec, TEST_FD, 0, 1024) == 0);
+      ret = at24c02_rec_read(&rec, got, sizeof(got));
+      if (ret == (int)len && !memcmp(got, buf, len))
+        break;
+      CHECK(wret && ret == (int)cur_len && !memcmp(got, cur, cur_len));
+    }
+    memcpy(cur, buf, len);
+    cur_len = len;
+  }
+}
+
+// 键值存储的模型: 键 k<i> 当前是否存在及其值
+#define KV_TEST_KEYS 24
+struct kv_model {
+  int present[KV_TEST_KEYS];
+  size_t len[KV_TEST_KEYS];
+  __u8 val[KV_TEST_KEYS][AT24C02_KV_VAL_MAX];
+};
+
+static int kv_matches(struct at24c02_kv *kv, const struct kv_model *m) {
+  __u8 got[AT24C02_KV_VAL_MAX];
+  char key[16];
+  int i, ret;
+
+  for (i = 0; i < KV_TEST_KEYS; i++) {
+    snprintf(key, sizeof(key), "k%d", i);
+    ret = at24c02_kv_get(kv, key, got, sizeof(got));
+    if (m->present[i] ? ret != (int)m->len[i] || memcmp(got, m->val[i], ret)
+                      : ret != -ENOENT)
+      return 0;
+  }
+  return 1;
+}
+
+static void test_kv_basic(void) {
+  static struct at24c02_kv kv;
+  __u8 got[AT24C02_KV_VAL_MAX];
+
+  memset(chip, 0xff, sizeof(chip));
+  CHECK(at24c02_kv_open(&kv, TEST_FD, 0, 1024) == 0);
+  CHECK(at24c02_kv_get(&kv, "name", got, sizeof(got)) == -ENOENT);
+  CHECK(at24c02_kv_put(&kv, "name", "board-a", 7) == 0);
+  CHECK(at24c02_kv_put(&kv, "rev", "3", 1) == 0);
+  CHECK(at24c02_kv_put(&kv, "name", "board-b", 7) == 0);
+  CHECK(at24c02_kv_del(&kv, "rev") == 0);
+
+  memset(&kv, 0, sizeof(kv));
+  CHECK(at24c02_kv_open(&kv, TEST_FD, 0, 1024) == 0);
+  CHECK(at24c02_kv_get(&kv, "name", got, sizeof(got)) == 7 &&
+        !memcmp(got, "board-b", 7));
+  CHECK(at24c02_kv_get(&kv, "rev", got, sizeof(got)) == -ENOENT);
+}
+
+// 写满之后删除和用更短的值覆盖都必须成功, 删除后又能写入新键
+static void test_kv_full(void) {
+  static struct at24c02_kv kv;
+  __u8 val[AT24C02_KV_VAL_MAX];
+  char key[16];
+  int i, ret;
+
+  memset(chip, 0xff, sizeof(chip));
+  CHECK(at24c02_kv_open(&kv, TEST_FD, 0, 1024) == 0);
+  memset(val, 'x', sizeof(val));
+  for (i = 0;; i++) {
+    snprintf(key, sizeof(key), "k%d", i);
+    ret = at24c02_kv_put(&kv, key, val, sizeof(val));
+    if (ret)
+      break;
+  }
+  CHECK(ret == -ENOSPC && i > 0);
+
+  CHECK(at24c02_kv_put(&kv, "k1", val, sizeof(val) - 1) == 0);
+  CHECK(at24c02_kv_del(&kv, "k0") == 0);
+  CHECK(at24c02_kv_put(&kv, "new", val, sizeof(val)) == 0);
+  CHECK(at24c02_kv_del(&kv, "new") == 0);
+  CHECK(at24c02_kv_put(&kv, "new", val, 4) == 0);
+
+  memset(&kv, 0, sizeof(kv));
+  CHECK(at24c02_kv_open(&kv, TEST_FD, 0, 1024) == 0);
+  CHECK(at24c02_kv_get(&kv, "k0", val, sizeof(val)) == -ENOENT);
+  CHECK(at24c02_kv_get(&kv, "k1", val, sizeof(val)) == AT24C02_KV_VAL_MAX - 1);
+  CHECK(at24c02_kv_get(&kv, "new", val, sizeof(val)) == 4);
+}
+
+/*
+ * 随机的 put/del 序列, 每个操作依次在第 0, 1, 2 ... 次页写后掉电重试,
+ * 每次重新打开后其他键不变, 被操作的键是旧状态或新状态; 操作返回成功后必须是新状态
+ */
+static void test_kv_torn(void) {
+  static struct at24c02_kv kv;
+  static struct kv_model m, next;
+  __u8 val[AT24C02_KV_VAL_MAX];
+  char key[16];
+  size_t len;
+  long n;
+  int op, i, ret;
+
+  memset(chip, 0xff, sizeof(chip));
+  memset(&m, 0, sizeof(m));
+  CHECK(at24c02_kv_open(&kv, TEST_FD, 0, 1024) == 0);
+  srand(1);
+
+  for (op = 0; op < 600; op++) {
+    i = rand() % KV_TEST_KEYS;
+    snprintf(key, sizeof(key), "k%d", i);
+    len = rand() % (AT24C02_KV_VAL_MAX + 1);
+    fill(val, len, op);
+    next = m;
+    if (rand() % 4 == 0) {
+      next.present[i] = 0;
+    } else {
+      next.present[i] = 1;
+      next.len[i] = len;
+      memcpy(next.val[i], val, len);
+    }
+
+    for (n = 0;; n++) {
+      page_budget = n;
+      ret = next.present[i] ? at24c02_kv_put(&kv, key, val, len)
+                            : at24c02_kv_del(&kv, key);
+      page_budget = -1;
+      if (ret == -ENOSPC || (ret == -ENOENT && !m.present[i])) {
+        next = m;
+        break;
+      }
+
+      memset(&kv, 0, sizeof(kv));
+      CHECK(at24c02_kv_open(&kv, TEST_FD, 0, 1024) == 0);
+      if (kv_matches(&kv, &next))
+        break;
+      CHECK(ret && kv_matches(&kv, &m));
+    }
+    m = next;
+  }
+}
+
+int main(void) {
+  test_rec_basic();
+  test_rec_torn();
+  test_kv_basic();
+  test_kv_full();
+  test_kv_torn();
+
+  if (failures) {
+    printf("%d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("all store tests passed\n");
+  return 0;
+}
@@ -1,45 +1,59 @@
+#include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
+#include <string.h>
 #include <sys/select.h>
 #include <unistd.h>
-#include <sys/ioctl.h>
 
 int main(int argc, char **argv) {
-  int fd;
+  int fd, ret;
   fd_set readfds, writefds;
+  const char msg[] = "hello fifo";
+  char buf[64];
 
-  // 打开你的设备文件
-  fd = open("/dev/mydevice", O_RDWR);
+  // 打开你的设备文件 (第 0 个通道), 非阻塞以便观察 FIFO 空/满时的 -EAGAIN
+  fd = open("/dev/mydevice0", O_RDWR | O_NONBLOCK);
   if (fd < 0) {
-    perror("Failed to open /dev/mydevice");
+    perror("Failed to open /dev/mydevice0");
     return -1;
   }
 
+  // 1. FIFO 为空, 非阻塞读应立即返回 EAGAIN
+  ret = read(fd, buf, sizeof(buf));
+  printf("Read on empty fifo: %d (%s)\n", ret, ret < 0 ? strerror(errno) : "");
+
+  // 2. 写入一条数据, 设备应同时可读可写
+  ret = write(fd, msg, strlen(msg));
+  printf("Wrote %d bytes\n", ret);
+
   // 设置文件描述符集合
   FD_ZERO(&readfds);
   FD_ZERO(&writefds);
   FD_SET(fd, &readfds);
   FD_SET(fd, &writefds);
 
-  ioctl(int fd, unsigned long request, ...)
-
   printf("Waiting for device to be ready to read or write...\n");
 
-    // 设置超时时间为永不超时 (NULL)
-    int ret = select(fd + 1, &readfds, &writefds, NULL, NULL);
-
-    if (ret == -1) {
-        perror("select");
-    } else if (ret) {
-        // select 成功返回，检查是哪个事件
-        if (FD_ISSET(fd, &readfds)) {
-            printf("Device is ready to read!\n");
-        }
-        if (FD_ISSET(fd, &writefds)) {
-            printf("Device is ready to write!\n");
-        }
+  // 设置超时时间为永不超时 (NULL)
+  ret = select(fd + 1, &readfds, &writefds, NULL, NULL);
+
+  if (ret == -1) {
+    perror("select");
+  } else if (ret) {
+    // select 成功返回，检查是哪个事件
+    if (FD_ISSET(fd, &readfds)) {
+      printf("Device is ready to read!\n");
     }
+    if (FD_ISSET(fd, &writefds)) {
+      printf("Device is ready to write!\n");
+    }
+  }
+
+  // 3. 读回数据
+  memset(buf, 0, sizeof(buf));
+  ret = read(fd, buf, sizeof(buf) - 1);
+  printf("Read %d bytes: %s\n", ret, ret > 0 ? buf : "");
 
-    close(fd);
-    return 0;
-}
\ No newline at end of file
+  close(fd);
+  return 0;
+}
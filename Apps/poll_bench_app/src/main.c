@@ -0,0 +1,302 @@
+#include "mydevice_header.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * /dev/mydevice 吞吐量测试: 一个生产者进程写, 一个消费者进程读
+ * 用法: poll_bench_app [设备] [每次读写字节数] [总 MiB] [rw|mmap|herd] [读者数]
+ * 在多核板子上分别加载 spsc=0 / spsc=1 的驱动对比结果
+ * mmap 模式 (需要 spsc=1) 直接读写共享的环形缓冲区, 只在空/满边界调用门铃
+ * herd 模式启动多个阻塞读者, 统计每条消息引起的上下文切换次数, 观察惊群
+ */
+#define DEFAULT_DEVICE "/dev/mydevice0"
+
+static double now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 映射控制页和数据区
+static struct mydevice_ring_ctrl *ring_map(int fd, size_t *len) {
+  struct mydevice_ring_ctrl *ctrl;
+  long page = sysconf(_SC_PAGESIZE);
+
+  ctrl = mmap(NULL, page, PROT_READ, MAP_SHARED, fd, 0);
+  if (ctrl == MAP_FAILED)
+    return NULL;
+  *len = ctrl->data_offset + ctrl->size;
+  munmap(ctrl, page);
+  ctrl = mmap(NULL, *len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  return ctrl == MAP_FAILED ? NULL : ctrl;
+}
+
+static void ring_wait(int fd, short events) {
+  struct pollfd pfd = {.fd = fd, .events = events};
+
+  poll(&pfd, 1, -1);
+}
+
+static int ring_producer(const char *path, size_t chunk, long long total) {
+  struct mydevice_ring_ctrl *ctrl;
+  __u32 head, tail, n, off, first;
+  long long done = 0;
+  size_t len;
+  char *data;
+  int fd;
+
+  fd = open(path, O_RDWR);
+  if (fd < 0 || !(ctrl = ring_map(fd, &len))) {
+    perror("producer mmap");
+    return 1;
+  }
+  data = (char *)ctrl + ctrl->data_offset;
+  head = ctrl->head;
+  while (done < total) {
+    // 1. 满时睡在 poll 上, 由消费者的 CONSUMED 门铃唤醒
+    tail = __atomic_load_n(&ctrl->tail, __ATOMIC_ACQUIRE);
+    if (head - tail == ctrl->size) {
+      ring_wait(fd, POLLOUT);
+      continue;
+    }
+
+    // 2. 直接写共享内存, 再以 release 语义发布
+    n = ctrl->size - (head - tail);
+    if (n > chunk)
+      n = chunk;
+    if (n > total - done)
+      n = total - done;
+    off = head & (ctrl->size - 1);
+    first = n < ctrl->size - off ? n : ctrl->size - off;
+    memset(data + off, 0x5a, first);
+    memset(data, 0x5a, n - first);
+    __atomic_store_n(&ctrl->head, head + n, __ATOMIC_RELEASE);
+
+    // 3. 原来为空时读者可能在睡眠, 按门铃
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ctrl->tail, __ATOMIC_RELAXED) == head)
+      ioctl(fd, MYDEVICE_RING_PRODUCED);
+    head += n;
+    done += n;
+  }
+  munmap(ctrl, len);
+  close(fd);
+  return 0;
+}
+
+// 消费者直接在共享内存中处理数据, 返回门铃次数
+static long long ring_consumer(int fd, size_t chunk, long long total,
+                               long long *done) {
+  struct mydevice_ring_ctrl *ctrl;
+  __u32 head, tail, n;
+  long long calls = 0;
+  size_t len;
+
+  ctrl = ring_map(fd, &len);
+  if (!ctrl) {
+    perror("consumer mmap");
+    return -1;
+  }
+  tail = ctrl->tail;
+  while (*done < total) {
+    head = __atomic_load_n(&ctrl->head, __ATOMIC_ACQUIRE);
+    if (head == tail) {
+      ring_wait(fd, POLLIN);
+      calls++;
+      continue;
+    }
+    n = head - tail;
+    if (n > chunk)
+      n = chunk;
+    __atomic_store_n(&ctrl->tail, tail + n, __ATOMIC_RELEASE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ctrl->head, __ATOMIC_RELAXED) - tail == ctrl->size) {
+      ioctl(fd, MYDEVICE_RING_CONSUMED);
+      calls++;
+    }
+    tail += n;
+    *done += n;
+  }
+  munmap(ctrl, len);
+  return calls;
+}
+
+// 多个读者阻塞在同一个设备上, 每条消息只应唤醒其中一个
+static int herd_bench(const char *path, size_t chunk, long long total,
+                      int readers) {
+  long long msgs = total / chunk, *received;
+  struct rusage ru;
+  double start, elapsed;
+  pid_t *pids;
+  char *buf;
+  ssize_t ret;
+  int fd, i;
+
+  received = mmap(NULL, sizeof(*received), PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  pids = calloc(readers, sizeof(*pids));
+  buf = calloc(1, chunk);
+  if (received == MAP_FAILED || !pids || !buf) {
+    perror("alloc");
+    return -1;
+  }
+
+  // 1. 启动读者, 各自打开设备并阻塞读取
+  for (i = 0; i < readers; i++) {
+    pids[i] = fork();
+    if (pids[i] == 0) {
+      fd = open(path, O_RDONLY);
+      if (fd < 0)
+        exit(1);
+      for (;;) {
+        ret = read(fd, buf, chunk);
+        if (ret > 0)
+          __atomic_add_fetch(received, ret, __ATOMIC_RELAXED);
+      }
+    }
+  }
+  sleep(1);
+
+  // 2. 逐条写入消息, 等全部被读走
+  fd = open(path, O_WRONLY);
+  if (fd < 0) {
+    perror("Failed to open device");
+    return -1;
+  }
+  start = now();
+  for (i = 0; i < msgs; i++) {
+    if (write(fd, buf, chunk) < 0 && errno != EINTR) {
+      perror("write");
+      break;
+    }
+  }
+  while (__atomic_load_n(received, __ATOMIC_RELAXED) < msgs * (long long)chunk)
+    usleep(1000);
+  elapsed = now() - start;
+
+  // 3. 结束读者, 汇总它们的上下文切换次数
+  for (i = 0; i < readers; i++) {
+    kill(pids[i], SIGTERM);
+    waitpid(pids[i], NULL, 0);
+  }
+  getrusage(RUSAGE_CHILDREN, &ru);
+  printf("%d readers, %lld messages of %zu bytes in %.3f s\n", readers, msgs,
+         chunk, elapsed);
+  printf("reader context switches: %ld voluntary, %ld involuntary, %.2f per "
+         "message\n",
+         ru.ru_nvcsw, ru.ru_nivcsw,
+         msgs ? (double)(ru.ru_nvcsw + ru.ru_nivcsw) / msgs : 0.0);
+
+  close(fd);
+  free(buf);
+  free(pids);
+  munmap(received, sizeof(*received));
+  return 0;
+}
+
+static int producer(const char *path, size_t chunk, long long total) {
+  char *buf = malloc(chunk);
+  long long done = 0;
+  ssize_t ret;
+  int fd;
+
+  fd = open(path, O_WRONLY);
+  if (fd < 0 || !buf) {
+    perror("producer open");
+    return 1;
+  }
+  memset(buf, 0x5a, chunk);
+  while (done < total) {
+    ret = write(fd, buf, total - done < (long long)chunk ? (size_t)(total - done) : chunk);
+    if (ret < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("write");
+      return 1;
+    }
+    done += ret;
+  }
+  close(fd);
+  free(buf);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  const char *path = argc > 1 ? argv[1] : DEFAULT_DEVICE;
+  size_t chunk = argc > 2 ? strtoul(argv[2], NULL, 0) : 4096;
+  long long total = (argc > 3 ? atoll(argv[3]) : 256) << 20;
+  int use_mmap = argc > 4 && !strcmp(argv[4], "mmap");
+  int readers = argc > 5 ? atoi(argv[5]) : 32;
+  long long done = 0, calls = 0;
+  struct rusage ru;
+  double start, elapsed;
+  char *buf;
+  ssize_t ret;
+  pid_t pid;
+  int fd, status;
+
+  if (argc > 4 && !strcmp(argv[4], "herd"))
+    return herd_bench(path, chunk, total, readers);
+
+  // 1. 消费者先打开读端, 再启动生产者
+  buf = malloc(chunk);
+  fd = open(path, use_mmap ? O_RDWR : O_RDONLY);
+  if (fd < 0 || !buf) {
+    perror("Failed to open device");
+    return -1;
+  }
+  pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    return -1;
+  }
+  if (pid == 0) {
+    close(fd);
+    exit(use_mmap ? ring_producer(path, chunk, total)
+                  : producer(path, chunk, total));
+  }
+
+  // 2. 读完全部数据, 统计系统调用次数
+  start = now();
+  if (use_mmap && (calls = ring_consumer(fd, chunk, total, &done)) < 0)
+    return -1;
+  while (!use_mmap && done < total) {
+    ret = read(fd, buf, chunk);
+    if (ret < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("read");
+      break;
+    }
+    done += ret;
+    calls++;
+  }
+  elapsed = now() - start;
+  waitpid(pid, &status, 0);
+  getrusage(RUSAGE_SELF, &ru);
+
+  // 3. 输出结果
+  printf("chunk %zu bytes, %lld MiB in %.3f s\n", chunk, done >> 20, elapsed);
+  printf("throughput: %.1f MiB/s, %.0f %s/s, %.1f bytes/call\n",
+         done / elapsed / (1 << 20), calls / elapsed,
+         use_mmap ? "syscalls" : "reads",
+         calls ? (double)done / calls : 0.0);
+  printf("consumer context switches: %ld voluntary, %ld involuntary\n",
+         ru.ru_nvcsw, ru.ru_nivcsw);
+
+  close(fd);
+  free(buf);
+  return 0;
+}
@@ -1,7 +1,7 @@
 /***************************************************************
 文件名     : at24c02_driver.c
 作者       : ccoisini
-描述       : dht11 驱动程序, GPIO4_PIN19-----DHT11 IO port
+描述       : at24c02 EEPROM 驱动程序, 提供字符设备 ioctl 接口及 nvmem provider
 
 使用方法：
 在.dts文件中定义节点信息
@@ -15,142 +15,1602 @@
     at24c02: at24c02@50{
       compatible = "ccoisini,at24c02";
       reg = <0x50>;
+      // 其他型号: "ccoisini,at24c04" ... "ccoisini,at24c512"
+      // 可选: 覆盖型号默认参数
+      // size = <256>;
+      // pagesize = <8>;
+      // address-width = <8>;
+      #address-cells = <1>;
+      #size-cells = <1>;
+
+      // 可选: 描述 nvmem cell, 供其他驱动通过 nvmem-cells 引用
+      eth_mac: mac-address@0 {
+        reg = <0x00 0x06>;
+      };
     };
   };
 
-***************************************************************/
+  用户空间也可以直接读写 /sys/bus/nvmem/devices/<name>/nvmem
+
+***************************************************************/
+
+#include "at24c02_header.h"
+
+#define CREATE_TRACE_POINTS
+#include "at24c02_trace.h"
+
+// 各型号默认参数
+static const struct at24c02_chip_info at24c02_chip_24c02 = {.size = 256, .page_size = 8, .addr_width = 1};
+static const struct at24c02_chip_info at24c02_chip_24c04 = {.size = 512, .page_size = 16, .addr_width = 1};
+static const struct at24c02_chip_info at24c02_chip_24c08 = {.size = 1024, .page_size = 16, .addr_width = 1};
+static const struct at24c02_chip_info at24c02_chip_24c16 = {.size = 2048, .page_size = 16, .addr_width = 1};
+static const struct at24c02_chip_info at24c02_chip_24c32 = {.size = 4096, .page_size = 32, .addr_width = 2};
+static const struct at24c02_chip_info at24c02_chip_24c64 = {.size = 8192, .page_size = 32, .addr_width = 2};
+static const struct at24c02_chip_info at24c02_chip_24c128 = {.size = 16384, .page_size = 64, .addr_width = 2};
+static const struct at24c02_chip_info at24c02_chip_24c256 = {.size = 32768, .page_size = 64, .addr_width = 2};
+static const struct at24c02_chip_info at24c02_chip_24c512 = {.size = 65536, .page_size = 128, .addr_width = 2};
+
+// 是否在 probe 后后台预取整片内容到影子缓存
+static bool prefetch = true;
+module_param(prefetch, bool, 0444);
+MODULE_PARM_DESC(prefetch, "Read the whole EEPROM into the cache in the background after probe");
+
+// debugfs 根目录 /sys/kernel/debug/at24c02, 每个实例一个子目录
+static struct dentry *at24c02_debugfs_root;
+
+// 模块级资源: 所有 EEPROM 实例共用一个设备类和一段设备号, 次设备号按实例动态分配
+static struct class *at24c02_class;
+static dev_t at24c02_devt;
+static DEFINE_IDA(at24c02_minor_ida);
+
+// 传输缓冲区中数据区的起始位置, 其前面保留了字地址字节
+static inline u8 *at24c02_xfer_data(struct at24c02_struct *my_data) { return my_data->xfer_buf + AT24C02_ADDR_LEN_MAX; }
+
+/*
+ * 把 EEPROM 内部偏移转换为 I2C 从机地址和字地址字节 (高字节在前)
+ * 单字节寻址且容量超过 256 字节的型号 (24c04/08/16) 用从机地址低位选择块
+ */
+static u16 at24c02_translate(struct at24c02_struct *my_data, unsigned int offset, u8 *addr_buf)
+{
+    if (my_data->addr_width == 2)
+    {
+        addr_buf[0] = offset >> 8;
+        addr_buf[1] = offset & 0xff;
+        return my_data->client->addr;
+    }
+
+    addr_buf[0] = offset & 0xff;
+    return my_data->clients[offset / AT24C02_BLOCK_SIZE]->addr;
+}
+
+static void at24c02_hist_add(struct at24c02_hist *hist, u64 ns)
+{
+    unsigned int idx = fls64(div_u64(ns, NSEC_PER_USEC));
+
+    hist->bucket[min_t(unsigned int, idx, AT24C02_HIST_BUCKETS - 1)]++;
+}
+
+static void at24c02_cache_account(struct at24c02_struct *my_data, bool hit)
+{
+    atomic64_inc(hit ? &my_data->cache_hits : &my_data->cache_misses);
+}
+
+/*
+ * 影子缓存: cache 保存芯片内容的副本, cache_valid 标记哪些字节有效
+ * 只有持有 lock (总线锁) 的路径才会修改缓存, 修改时再取 cache_lock 写锁;
+ * 不持有 lock 的读者取 cache_lock 读锁即可, 因此缓存命中的读不必等待总线,
+ * 即使另一个进程正处于页写周期内
+ */
+static bool at24c02_cache_hit(struct at24c02_struct *my_data, unsigned int offset, size_t len)
+{
+    return find_next_zero_bit(my_data->cache_valid, offset + len, offset) >= offset + len;
+}
+
+// 调用者需持有 my_data->lock
+static void at24c02_cache_fill(struct at24c02_struct *my_data, unsigned int offset, const u8 *buf, size_t len)
+{
+    down_write(&my_data->cache_lock);
+    memcpy(my_data->cache + offset, buf, len);
+    bitmap_set(my_data->cache_valid, offset, len);
+    up_write(&my_data->cache_lock);
+}
+
+// 调用者需持有 my_data->lock
+static void at24c02_cache_invalidate(struct at24c02_struct *my_data, unsigned int offset, size_t len)
+{
+    down_write(&my_data->cache_lock);
+    bitmap_clear(my_data->cache_valid, offset, len);
+    up_write(&my_data->cache_lock);
+}
+
+/*
+ * 不持有 lock 时尝试从缓存读取, 全部命中返回 true
+ * 只统计命中: 未命中时调用者随后持锁走 at24c02_read_locked, 由它统计一次
+ */
+static bool at24c02_cache_read(struct at24c02_struct *my_data, unsigned int offset, u8 *buf, size_t len)
+{
+    bool hit;
+
+    down_read(&my_data->cache_lock);
+    hit = at24c02_cache_hit(my_data, offset, len);
+    if (hit)
+    {
+        memcpy(buf, my_data->cache + offset, len);
+    }
+    up_read(&my_data->cache_lock);
+    if (hit)
+    {
+        at24c02_cache_account(my_data, true);
+    }
+    return hit;
+}
+
+/*
+ * 读一个块: count 不超过 read_max, 且单字节寻址时不跨 256 字节块
+ * I2C 模式用一次组合传输(写地址 + 读数据), 字地址放在预分配缓冲区头部;
+ * SMBus 模式用 I2C block read 或逐字节读
+ */
+static int at24c02_read_chunk(struct at24c02_struct *my_data, unsigned int offset, u8 *buf, size_t count)
+{
+    struct i2c_client *client = my_data->client;
+    union i2c_smbus_data smbus;
+    struct i2c_msg msgs[2];
+    u16 addr;
+    int ret;
+
+    addr = at24c02_translate(my_data, offset, my_data->xfer_buf);
+
+    switch (my_data->read_mode)
+    {
+    case AT24C02_XFER_I2C:
+        // 消息1: 设置要读取的地址 (写操作)
+        msgs[0].addr = addr;
+        msgs[0].flags = 0;
+        msgs[0].len = my_data->addr_width;
+        msgs[0].buf = my_data->xfer_buf;
+
+        // 消息2: 从该地址读取数据 (读操作)
+        msgs[1].addr = addr;
+        msgs[1].flags = I2C_M_RD;
+        msgs[1].len = count;
+        msgs[1].buf = buf;
+
+        ret = i2c_transfer(client->adapter, msgs, 2);
+        if (ret != 2)
+        {
+            return ret < 0 ? ret : -EIO;
+        }
+        return 0;
+    case AT24C02_XFER_SMBUS_BLOCK:
+        smbus.block[0] = count;
+        ret = i2c_smbus_xfer(client->adapter, addr, client->flags, I2C_SMBUS_READ, my_data->xfer_buf[0],
+                             I2C_SMBUS_I2C_BLOCK_DATA, &smbus);
+        if (ret < 0)
+        {
+            return ret;
+        }
+        memcpy(buf, &smbus.block[1], count);
+        return 0;
+    default:
+        ret = i2c_smbus_xfer(client->adapter, addr, client->flags, I2C_SMBUS_READ, my_data->xfer_buf[0],
+                             I2C_SMBUS_BYTE_DATA, &smbus);
+        if (ret < 0)
+        {
+            return ret;
+        }
+        buf[0] = smbus.byte;
+        return 0;
+    }
+}
+
+/*
+ * 顺序读: 按适配器允许的最大长度拆分, 芯片内部地址自动递增
+ * 单字节寻址的多块型号按块拆分, 因为每块对应不同的从机地址
+ * 调用者需持有 my_data->lock
+ */
+static int at24c02_eeprom_read(struct at24c02_struct *my_data, unsigned int offset, u8 *buf, size_t len)
+{
+    struct i2c_client *client = my_data->client;
+    size_t count;
+    u64 start, ns;
+    int ret;
+
+    while (len)
+    {
+        count = min_t(size_t, len, my_data->read_max);
+        if (my_data->addr_width == 1 && count > AT24C02_BLOCK_SIZE - offset % AT24C02_BLOCK_SIZE)
+        {
+            count = AT24C02_BLOCK_SIZE - offset % AT24C02_BLOCK_SIZE;
+        }
+
+        start = ktime_get_ns();
+        ret = at24c02_read_chunk(my_data, offset, buf, count);
+        ns = ktime_get_ns() - start;
+        trace_at24c02_xfer(i2c_adapter_id(client->adapter), client->addr, false, offset, count, ret, ns);
+        at24c02_hist_add(&my_data->hist_read, ns);
+        if (ret)
+        {
+            my_data->xfer_errors++;
+            pr_err("I2C random read failed: %d\n", ret);
+            return ret;
+        }
+        at24c02_cache_fill(my_data, offset, buf, count);
+
+        offset += count;
+        buf += count;
+        len -= count;
+    }
+    return 0;
+}
+
+/*
+ * 写一个块: count 不超过 write_max 且不跨页
+ * I2C 模式下 buf 必须位于传输缓冲区的数据区内: 数据前的 addr_width 个字节临时用作字地址,
+ * 这样无需再拷贝即可组成 [地址][数据] 报文, 发送后恢复原值
+ */
+static int at24c02_write_chunk(struct at24c02_struct *my_data, unsigned int offset, u8 *buf, size_t count)
+{
+    struct i2c_client *client = my_data->client;
+    u8 saved[AT24C02_ADDR_LEN_MAX];
+    union i2c_smbus_data smbus;
+    struct i2c_msg msg;
+    u8 addr_buf[AT24C02_ADDR_LEN_MAX];
+    u8 *msg_buf;
+    u16 addr;
+    int ret;
+
+    switch (my_data->write_mode)
+    {
+    case AT24C02_XFER_I2C:
+        // 报文开头是EEPROM内部地址
+        msg_buf = buf - my_data->addr_width;
+        memcpy(saved, msg_buf, my_data->addr_width);
+
+        msg.addr = at24c02_translate(my_data, offset, msg_buf);
+        msg.flags = 0;
+        msg.len = count + my_data->addr_width;
+        msg.buf = msg_buf;
+
+        ret = i2c_transfer(client->adapter, &msg, 1);
+        memcpy(msg_buf, saved, my_data->addr_width);
+        if (ret != 1)
+        {
+            return ret < 0 ? ret : -EIO;
+        }
+        return 0;
+    case AT24C02_XFER_SMBUS_BLOCK:
+        addr = at24c02_translate(my_data, offset, addr_buf);
+        smbus.block[0] = count;
+        memcpy(&smbus.block[1], buf, count);
+        return i2c_smbus_xfer(client->adapter, addr, client->flags, I2C_SMBUS_WRITE, addr_buf[0],
+                              I2C_SMBUS_I2C_BLOCK_DATA, &smbus);
+    case AT24C02_XFER_SMBUS_BYTE:
+        addr = at24c02_translate(my_data, offset, addr_buf);
+        smbus.byte = buf[0];
+        return i2c_smbus_xfer(client->adapter, addr, client->flags, I2C_SMBUS_WRITE, addr_buf[0],
+                              I2C_SMBUS_BYTE_DATA, &smbus);
+    default:
+        return -EOPNOTSUPP;
+    }
+}
+
+/*
+ * 页写: 按页边界和适配器允许的最大长度拆分, 避免页内地址回绕覆盖数据
+ * buf 的要求见 at24c02_write_chunk, 调用者需持有 my_data->lock
+ */
+static int at24c02_eeprom_write(struct at24c02_struct *my_data, unsigned int offset, u8 *buf, size_t len)
+{
+    struct i2c_client *client = my_data->client;
+    size_t count;
+    u64 start, ns;
+    int ret;
+
+    if (my_data->write_mode == AT24C02_XFER_NONE)
+    {
+        return -EOPNOTSUPP;
+    }
+
+    while (len)
+    {
+        // 本次写入不能超过当前页的剩余空间
+        count = my_data->page_size - (offset % my_data->page_size);
+        count = min3(count, len, (size_t)my_data->write_max);
+
+        start = ktime_get_ns();
+        ret = at24c02_write_chunk(my_data, offset, buf, count);
+        ns = ktime_get_ns() - start;
+        trace_at24c02_xfer(i2c_adapter_id(client->adapter), client->addr, true, offset, count, ret, ns);
+        at24c02_hist_add(&my_data->hist_write, ns);
+        if (ret)
+        {
+            my_data->xfer_errors++;
+            // 写失败后芯片中的内容不确定, 让缓存失效
+            at24c02_cache_invalidate(my_data, offset, count);
+            pr_err("I2C page write failed: %d\n", ret);
+            return ret;
+        }
+
+        // 写穿缓存: 页写周期内其他进程的读直接从缓存返回
+        at24c02_cache_fill(my_data, offset, buf, count);
+        my_data->stats.pages_written++;
+
+        // Must have 20ms delay for writing
+        // 用 msleep 让出 CPU, 期间只有总线锁被占用
+        start = ktime_get_ns();
+        msleep(AT24C02_WRITE_CYCLE_MS);
+        ns = ktime_get_ns() - start;
+        trace_at24c02_write_cycle(i2c_adapter_id(client->adapter), client->addr, offset, ns);
+        at24c02_hist_add(&my_data->hist_cycle, ns);
+
+        offset += count;
+        buf += count;
+        len -= count;
+    }
+    return 0;
+}
+
+// 持有 lock 时的读: 缓存全部命中则直接拷贝, 否则访问芯片 (并回填缓存)
+static int at24c02_read_locked(struct at24c02_struct *my_data, unsigned int offset, u8 *buf, size_t len)
+{
+    bool hit = at24c02_cache_hit(my_data, offset, len);
+
+    at24c02_cache_account(my_data, hit);
+    if (hit)
+    {
+        memcpy(buf, my_data->cache + offset, len);
+        return 0;
+    }
+    return at24c02_eeprom_read(my_data, offset, buf, len);
+}
+
+/*
+ * 比较写入: 从缓存或一次顺序读取得目标区间的当前内容, 逐页比较,
+ * 内容相同的页直接跳过, 不同的页只写入首个到末个差异字节之间的部分
+ * buf 的要求与 at24c02_eeprom_write 相同, 调用者需持有 my_data->lock
+ */
+static int at24c02_eeprom_update(struct at24c02_struct *my_data, unsigned int offset, u8 *buf, size_t len)
+{
+    u8 *old = my_data->cmp_buf;
+    size_t pos, count, first, last;
+    int ret;
+
+    ret = at24c02_read_locked(my_data, offset, old, len);
+    if (ret)
+    {
+        return ret;
+    }
+
+    for (pos = 0; pos < len; pos += count)
+    {
+        count = my_data->page_size - ((offset + pos) % my_data->page_size);
+        if (count > len - pos)
+        {
+            count = len - pos;
+        }
+
+        // 找出本页内第一个和最后一个不同的字节
+        for (first = pos; first < pos + count && buf[first] == old[first]; first++)
+            ;
+        if (first == pos + count)
+        {
+            my_data->stats.pages_skipped++;
+            my_data->stats.bytes_skipped += count;
+            continue;
+        }
+        for (last = pos + count - 1; buf[last] == old[last]; last--)
+            ;
+
+        ret = at24c02_eeprom_write(my_data, offset + first, buf + first, last - first + 1);
+        if (ret)
+        {
+            return ret;
+        }
+        my_data->stats.bytes_skipped += count - (last - first + 1);
+    }
+    return 0;
+}
+
+/*
+ * 后台预取: probe 之后按块顺序读出整片内容填充影子缓存
+ * 每块之间释放总线锁, 其他访问可以插入; prefetch_pos 之前的内容均已在缓存中
+ */
+static void at24c02_prefetch_work(struct work_struct *work)
+{
+    struct at24c02_struct *my_data = container_of(work, struct at24c02_struct, prefetch_work);
+    unsigned int pos, count;
+    int ret = 0;
+
+    for (pos = 0; pos < my_data->size; pos += count)
+    {
+        count = min_t(unsigned int, my_data->size - pos, AT24C02_PREFETCH_CHUNK);
+
+        mutex_lock(&my_data->lock);
+        if (!at24c02_cache_hit(my_data, pos, count))
+        {
+            ret = at24c02_eeprom_read(my_data, pos, at24c02_xfer_data(my_data), count);
+        }
+        mutex_unlock(&my_data->lock);
+        if (ret)
+        {
+            pr_err("at24c02: prefetch stopped at 0x%x: %d\n", pos, ret);
+            break;
+        }
+
+        WRITE_ONCE(my_data->prefetch_pos, pos + count);
+        wake_up_all(&my_data->prefetch_waitq);
+    }
+
+    WRITE_ONCE(my_data->prefetching, false);
+    wake_up_all(&my_data->prefetch_waitq);
+}
+
+/*
+ * 只有 [offset, offset+len) 与正在传输的预取块重叠时才等待, 且只等这一块完成.
+ * 预取尚未到达的区间不等待: 调用者缓存未命中后持锁直接读取芯片并回填缓存,
+ * 预取推进到那里时发现已命中会跳过
+ */
+static int at24c02_prefetch_wait(struct at24c02_struct *my_data, unsigned int offset, size_t len)
+{
+    unsigned int pos = READ_ONCE(my_data->prefetch_pos);
+
+    if (!READ_ONCE(my_data->prefetching) || pos >= offset + len || offset >= pos + AT24C02_PREFETCH_CHUNK)
+    {
+        return 0;
+    }
+    if (wait_event_interruptible(my_data->prefetch_waitq,
+                                 !READ_ONCE(my_data->prefetching) || READ_ONCE(my_data->prefetch_pos) != pos))
+    {
+        return -ERESTARTSYS;
+    }
+    return 0;
+}
+
+static int at24c02_nvmem_read(void *priv, unsigned int offset, void *val, size_t bytes)
+{
+    struct at24c02_struct *my_data = priv;
+    int ret;
+
+    if (offset + bytes > my_data->size)
+    {
+        return -EINVAL;
+    }
+
+    ret = at24c02_prefetch_wait(my_data, offset, bytes);
+    if (ret)
+    {
+        return ret;
+    }
+    if (at24c02_cache_read(my_data, offset, val, bytes))
+    {
+        return 0;
+    }
+
+    mutex_lock(&my_data->lock);
+    ret = at24c02_read_locked(my_data, offset, val, bytes);
+    mutex_unlock(&my_data->lock);
+    return ret;
+}
+
+static int at24c02_nvmem_write(void *priv, unsigned int offset, void *val, size_t bytes)
+{
+    struct at24c02_struct *my_data = priv;
+    int ret;
+
+    if (offset + bytes > my_data->size)
+    {
+        return -EINVAL;
+    }
+
+    // 先暂存到传输缓冲区的数据区, 以便页写时在数据前插入字地址
+    mutex_lock(&my_data->lock);
+    memcpy(at24c02_xfer_data(my_data), val, bytes);
+    ret = at24c02_eeprom_write(my_data, offset, at24c02_xfer_data(my_data), bytes);
+    mutex_unlock(&my_data->lock);
+    return ret;
+}
+
+static int at24c02_open(struct inode *inode, struct file *file)
+{
+    struct at24c02_struct *data = container_of(inode->i_cdev, struct at24c02_struct, cdev);
+    file->private_data = data;
+    pr_info("at24c02 device opened.\n");
+    return 0;
+}
+
+static int at24c02_release(struct inode *inode, struct file *file)
+{
+    pr_info("at24c02 device closed.\n");
+    return 0;
+}
+
+// 单次随机读 / 写
+static long at24c02_ioctl_rw(struct at24c02_struct *my_data, unsigned int cmd, unsigned long arg)
+{
+    int ret;
+    struct at24c02_io_data data;
+    u8 *kbuf;
+
+    // 1. 从用户空间复制 ioctl 的参数结构体
+    // 这步是必需的，它将用户传入的结构体内容复制到内核栈上
+    if (copy_from_user(&data, (struct at24c02_io_data __user *)arg, sizeof(data)))
+    {
+        return -EFAULT;
+    }
+
+    // 2. 验证参数
+    // 确保地址和长度都在EEPROM的有效范围内
+    if (data.address + data.len > my_data->size)
+    {
+        pr_err("Invalid address or length, exceeds device capacity.\n");
+        return -EINVAL;
+    }
+
+    switch (cmd)
+    {
+    case AT24C02_RANDOM_READ:
+    {
+        // 所需区间正在被预取时只等待这一块
+        ret = at24c02_prefetch_wait(my_data, data.address, data.len);
+        if (ret)
+        {
+            return ret;
+        }
+
+        // 缓存命中时只取 cache_lock 读锁, 不等待总线
+        // 命中路径不持有 lock, 不能借用传输缓冲区; 先拷到临时缓冲区,
+        // 释放读锁后再 copy_to_user, 用户页缺页时不会阻塞缓存的写者
+        kbuf = kmalloc(data.len, GFP_KERNEL);
+        if (!kbuf)
+        {
+            return -ENOMEM;
+        }
+        down_read(&my_data->cache_lock);
+        if (at24c02_cache_hit(my_data, data.address, data.len))
+        {
+            memcpy(kbuf, my_data->cache + data.address, data.len);
+            up_read(&my_data->cache_lock);
+            at24c02_cache_account(my_data, true);
+            ret = copy_to_user(data.buf, kbuf, data.len) ? -EFAULT : 0;
+            kfree(kbuf);
+            return ret;
+        }
+        up_read(&my_data->cache_lock);
+        kfree(kbuf);
+
+        // 使用预分配的传输缓冲区, 稳态路径不再分配内存
+        mutex_lock(&my_data->lock);
+        kbuf = at24c02_xfer_data(my_data);
+        ret = at24c02_read_locked(my_data, data.address, kbuf, data.len);
+
+        // 成功后，将数据复制回用户空间
+        if (!ret && copy_to_user(data.buf, kbuf, data.len))
+        {
+            ret = -EFAULT;
+        }
+        mutex_unlock(&my_data->lock);
+        return ret;
+    }
+    case AT24C02_BYTE_WRITE:
+    case AT24C02_UPDATE:
+    {
+        mutex_lock(&my_data->lock);
+        kbuf = at24c02_xfer_data(my_data);
+
+        // 从用户空间复制数据到传输缓冲区，页拆分由 at24c02_eeprom_write 完成
+        if (copy_from_user(kbuf, data.buf, data.len))
+        {
+            ret = -EFAULT;
+        }
+        else if (cmd == AT24C02_UPDATE)
+        {
+            ret = at24c02_eeprom_update(my_data, data.address, kbuf, data.len);
+        }
+        else
+        {
+            ret = at24c02_eeprom_write(my_data, data.address, kbuf, data.len);
+        }
+        mutex_unlock(&my_data->lock);
+        return ret;
+    }
+    default:
+        return -ENOTTY;
+    }
+}
+
+static int at24c02_batch_span_cmp(const void *a, const void *b)
+{
+    const struct at24c02_batch_span *x = a;
+    const struct at24c02_batch_span *y = b;
+
+    return (int)x->start - (int)y->start;
+}
+
+// 页写失败时, 把 [from, to) 中覆盖 [first, last] 的写条目标记为失败
+static void at24c02_batch_fail_writes(struct at24c02_struct *my_data, u32 from, u32 to, unsigned int first,
+                                      unsigned int last, int err)
+{
+    struct at24c02_batch_entry *e;
+    u32 i;
+
+    for (i = from; i < to; i++)
+    {
+        e = &my_data->batch_ents[i];
+        if (e->op == AT24C02_OP_WRITE && !e->result && e->address <= last && e->address + e->len > first)
+        {
+            e->result = err;
+        }
+    }
+}
+
+/*
+ * 把写镜像按页刷入 EEPROM: 每页只做一次页写
+ * 页内若有多段被写区间, 先读回中间的空洞补齐, 再整段写入, 避免多次写周期
+ */
+static void at24c02_batch_flush(struct at24c02_struct *my_data, u32 from, u32 to)
+{
+    u8 *image = at24c02_xfer_data(my_data);
+    unsigned long *dirty = my_data->batch_dirty;
+    unsigned int page, page_end, first, last, i;
+    int ret;
+
+    for (page = 0; page < my_data->size; page += my_data->page_size)
+    {
+        page_end = page + my_data->page_size;
+        first = find_next_bit(dirty, page_end, page);
+        if (first >= page_end)
+        {
+            continue;
+        }
+
+        last = first;
+        for (i = first + 1; i < page_end; i++)
+        {
+            if (test_bit(i, dirty))
+            {
+                last = i;
+            }
+        }
+
+        ret = 0;
+        if (find_next_zero_bit(dirty, last, first) < last)
+        {
+            ret = at24c02_read_locked(my_data, first, my_data->batch_page, last - first + 1);
+            for (i = first; !ret && i <= last; i++)
+            {
+                if (!test_bit(i, dirty))
+                {
+                    image[i] = my_data->batch_page[i - first];
+                }
+            }
+        }
+
+        if (!ret)
+        {
+            ret = at24c02_eeprom_write(my_data, first, image + first, last - first + 1);
+        }
+        if (ret)
+        {
+            at24c02_batch_fail_writes(my_data, from, to, first, last, ret);
+        }
+    }
+}
+
+/*
+ * 执行一个阶段 [from, to) 的条目: 先按页刷写写镜像, 再合并读区间, 每组只做一次顺序读
+ * 阶段内没有写条目覆盖更早的读条目, 因此先写后读与按提交顺序执行的结果相同
+ */
+static void at24c02_batch_run(struct at24c02_struct *my_data, u32 from, u32 to, unsigned int nspans, bool has_write)
+{
+    struct at24c02_batch_span *spans = my_data->batch_spans;
+    struct at24c02_batch_entry *e;
+    u8 *image = at24c02_xfer_data(my_data);
+    unsigned int start, end, i, j, k;
+    int err;
+
+    if (has_write)
+    {
+        at24c02_batch_flush(my_data, from, to);
+    }
+
+    sort(spans, nspans, sizeof(*spans), at24c02_batch_span_cmp, NULL);
+    for (i = 0; i < nspans; i = j)
+    {
+        start = spans[i].start;
+        end = spans[i].end;
+        for (j = i + 1; j < nspans && spans[j].start <= end + AT24C02_BATCH_MERGE_GAP; j++)
+        {
+            end = max_t(unsigned int, end, spans[j].end);
+        }
+
+        err = at24c02_read_locked(my_data, start, image + start, end - start);
+        for (k = i; k < j; k++)
+        {
+            e = &my_data->batch_ents[spans[k].index];
+            if (err)
+            {
+                e->result = err;
+            }
+            else if (copy_to_user(e->buf, image + e->address, e->len))
+            {
+                e->result = -EFAULT;
+            }
+        }
+    }
+}
+
+// 写条目是否覆盖本阶段已收集的某个读区间
+static bool at24c02_batch_overlaps(const struct at24c02_batch_span *spans, unsigned int nspans,
+                                   const struct at24c02_batch_entry *e)
+{
+    unsigned int i;
+
+    for (i = 0; i < nspans; i++)
+    {
+        if (e->address < spans[i].end && e->address + e->len > spans[i].start)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * 批量 ioctl: 条目按提交顺序分成若干阶段, 写条目覆盖本阶段更早的读条目时开始新阶段.
+ * 每个阶段内写条目叠加后按页刷写, 读区间合并为尽量少的顺序读, 结果逐条回写给用户
+ */
+static long at24c02_ioctl_batch(struct at24c02_struct *my_data, unsigned long arg)
+{
+    struct at24c02_batch batch;
+    struct at24c02_batch_entry *ents = my_data->batch_ents;
+    struct at24c02_batch_entry *e;
+    struct at24c02_batch_span *spans = my_data->batch_spans;
+    unsigned int nspans = 0, i, phase = 0;
+    bool has_write = false;
+    u8 *image;
+    long ret;
+
+    if (copy_from_user(&batch, (struct at24c02_batch __user *)arg, sizeof(batch)))
+    {
+        return -EFAULT;
+    }
+    if (!batch.count || batch.count > AT24C02_BATCH_MAX)
+    {
+        return -EINVAL;
+    }
+
+    mutex_lock(&my_data->lock);
+    image = at24c02_xfer_data(my_data);
+
+    if (copy_from_user(ents, batch.entries, batch.count * sizeof(*ents)))
+    {
+        ret = -EFAULT;
+        goto out_unlock;
+    }
+
+    // 1. 校验条目, 写数据按提交顺序叠加到写镜像(后写覆盖先写), 读条目收集为区间
+    bitmap_zero(my_data->batch_dirty, my_data->size);
+    for (i = 0; i < batch.count; i++)
+    {
+        e = &ents[i];
+        e->result = 0;
+        if (e->op > AT24C02_OP_WRITE || e->address + e->len > my_data->size)
+        {
+            e->result = -EINVAL;
+            continue;
+        }
+        if (!e->len)
+        {
+            continue;
+        }
+
+        if (e->op == AT24C02_OP_WRITE)
+        {
+            // 2. 写条目覆盖之前的读条目时, 先执行当前阶段, 让那些读拿到写之前的内容
+            if (at24c02_batch_overlaps(spans, nspans, e))
+            {
+                at24c02_batch_run(my_data, phase, i, nspans, has_write);
+                bitmap_zero(my_data->batch_dirty, my_data->size);
+                phase = i;
+                nspans = 0;
+                has_write = false;
+            }
+            if (copy_from_user(image + e->address, e->buf, e->len))
+            {
+                ret = -EFAULT;
+                goto out_unlock;
+            }
+            bitmap_set(my_data->batch_dirty, e->address, e->len);
+            has_write = true;
+        }
+        else
+        {
+            spans[nspans].start = e->address;
+            spans[nspans].end = e->address + e->len;
+            spans[nspans].index = i;
+            nspans++;
+        }
+    }
+
+    // 3. 执行最后一个阶段
+    at24c02_batch_run(my_data, phase, batch.count, nspans, has_write);
+
+    // 4. 统计失败条目并回写结果
+    ret = 0;
+    for (i = 0; i < batch.count; i++)
+    {
+        if (ents[i].result)
+        {
+            ret++;
+        }
+    }
+    if (copy_to_user(batch.entries, ents, batch.count * sizeof(*ents)))
+    {
+        ret = -EFAULT;
+    }
+
+out_unlock:
+    mutex_unlock(&my_data->lock);
+    return ret;
+}
+
+// 计算校验值, type 非法时返回 -EINVAL
+static int at24c02_crc_calc(u8 type, const u8 *buf, size_t len, u32 *crc)
+{
+    switch (type)
+    {
+    case AT24C02_CRC32:
+        *crc = crc32_le(~0, buf, len) ^ ~0;
+        return 0;
+    case AT24C02_CRC16:
+        *crc = crc16(0, buf, len);
+        return 0;
+    default:
+        return -EINVAL;
+    }
+}
+
+static unsigned int at24c02_crc_size(u8 type) { return type == AT24C02_CRC16 ? 2 : 4; }
+
+/*
+ * 区间校验: 优先在影子缓存上直接计算 (不占用总线),
+ * 否则一次顺序读到传输缓冲区后计算, 只返回校验值;
+ * 带 AT24C02_CRC_F_NOCACHE 时总是从芯片读取, 读到的内容同时刷新缓存
+ */
+static long at24c02_ioctl_crc(struct at24c02_struct *my_data, unsigned long arg)
+{
+    struct at24c02_crc_data data;
+    bool hit;
+    int ret;
+
+    if (copy_from_user(&data, (struct at24c02_crc_data __user *)arg, sizeof(data)))
+    {
+        return -EFAULT;
+    }
+    if (data.address + data.len > my_data->size || data.type > AT24C02_CRC16)
+    {
+        return -EINVAL;
+    }
+
+    ret = at24c02_prefetch_wait(my_data, data.address, data.len);
+    if (ret)
+    {
+        return ret;
+    }
+
+    down_read(&my_data->cache_lock);
+    hit = !(data.flags & AT24C02_CRC_F_NOCACHE) && at24c02_cache_hit(my_data, data.address, data.len);
+    if (hit)
+    {
+        ret = at24c02_crc_calc(data.type, my_data->cache + data.address, data.len, &data.crc);
+    }
+    up_read(&my_data->cache_lock);
+    if (hit)
+    {
+        at24c02_cache_account(my_data, true);
+    }
+
+    if (!hit)
+    {
+        mutex_lock(&my_data->lock);
+        if (data.flags & AT24C02_CRC_F_NOCACHE)
+        {
+            ret = at24c02_eeprom_read(my_data, data.address, at24c02_xfer_data(my_data), data.len);
+        }
+        else
+        {
+            ret = at24c02_read_locked(my_data, data.address, at24c02_xfer_data(my_data), data.len);
+        }
+        if (!ret)
+        {
+            ret = at24c02_crc_calc(data.type, at24c02_xfer_data(my_data), data.len, &data.crc);
+        }
+        mutex_unlock(&my_data->lock);
+    }
+    if (ret)
+    {
+        return ret;
+    }
+
+    if (copy_to_user((struct at24c02_crc_data __user *)arg, &data, sizeof(data)))
+    {
+        return -EFAULT;
+    }
+    if ((data.flags & AT24C02_CRC_F_COMPARE) && data.crc != data.expected)
+    {
+        return -EBADMSG;
+    }
+    return 0;
+}
+
+/*
+ * 带校验写入: 在总线锁内完成 写数据+校验值 -> 从芯片读回 -> 比较
+ * 写之前先让目标区间的缓存失效, 同时读取数据和校验值的读者会等待总线锁,
+ * 因此看不到只写了一半的记录
+ */
+static long at24c02_ioctl_write_crc(struct at24c02_struct *my_data, unsigned long arg)
+{
+    struct at24c02_crc_write data;
+    unsigned int total;
+    u8 *kbuf;
+    u32 crc;
+    int ret;
+
+    if (copy_from_user(&data, (struct at24c02_crc_write __user *)arg, sizeof(data)))
+    {
+        return -EFAULT;
+    }
+    if (data.type > AT24C02_CRC16)
+    {
+        return -EINVAL;
+    }
+    total = data.len + at24c02_crc_size(data.type);
+    if (data.address + total > my_data->size)
+    {
+        return -EINVAL;
+    }
+
+    mutex_lock(&my_data->lock);
+    kbuf = at24c02_xfer_data(my_data);
+    if (copy_from_user(kbuf, data.buf, data.len))
+    {
+        ret = -EFAULT;
+        goto out_unlock;
+    }
+
+    at24c02_crc_calc(data.type, kbuf, data.len, &crc);
+    if (data.type == AT24C02_CRC16)
+    {
+        put_unaligned_le16(crc, kbuf + data.len);
+    }
+    else
+    {
+        put_unaligned_le32(crc, kbuf + data.len);
+    }
+
+    at24c02_cache_invalidate(my_data, data.address, total);
+    ret = at24c02_eeprom_write(my_data, data.address, kbuf, total);
+    if (ret)
+    {
+        goto out_unlock;
+    }
+
+    // 绕过缓存从芯片读回并比较
+    ret = at24c02_eeprom_read(my_data, data.address, my_data->cmp_buf, total);
+    if (!ret && memcmp(my_data->cmp_buf, kbuf, total))
+    {
+        pr_err("at24c02: verify failed at 0x%x\n", data.address);
+        at24c02_cache_invalidate(my_data, data.address, total);
+        ret = -EIO;
+    }
+
+out_unlock:
+    mutex_unlock(&my_data->lock);
+    return ret;
+}
+
+/*
+ * 原子读-改-写: 在总线锁内 读(优先缓存) -> 修改 -> 比较写入,
+ * 修改后的数据放在传输缓冲区的数据区, 比较写入只写入发生变化的页
+ */
+static long at24c02_ioctl_cmpxchg(struct at24c02_struct *my_data, unsigned long arg)
+{
+    struct at24c02_cmpxchg data;
+    u8 expected[AT24C02_CMPXCHG_CHUNK];
+    unsigned int pos, count;
+    u8 *kbuf;
+    int ret;
+
+    if (copy_from_user(&data, (struct at24c02_cmpxchg __user *)arg, sizeof(data)))
+    {
+        return -EFAULT;
+    }
+    if (data.address + data.len > my_data->size)
+    {
+        return -EINVAL;
+    }
+
+    mutex_lock(&my_data->lock);
+    kbuf = at24c02_xfer_data(my_data);
+    ret = at24c02_read_locked(my_data, data.address, kbuf, data.len);
+    if (ret)
+    {
+        goto out_unlock;
+    }
+
+    // 分块比较当前内容与 expected
+    for (pos = 0; pos < data.len; pos += count)
+    {
+        count = min_t(unsigned int, data.len - pos, AT24C02_CMPXCHG_CHUNK);
+        if (copy_from_user(expected, data.expected + pos, count))
+        {
+            ret = -EFAULT;
+            goto out_unlock;
+        }
+        if (memcmp(expected, kbuf + pos, count))
+        {
+            ret = copy_to_user(data.expected, kbuf, data.len) ? -EFAULT : -EAGAIN;
+            goto out_unlock;
+        }
+    }
+
+    if (copy_from_user(kbuf, data.desired, data.len))
+    {
+        ret = -EFAULT;
+        goto out_unlock;
+    }
+    ret = at24c02_eeprom_update(my_data, data.address, kbuf, data.len);
+
+out_unlock:
+    mutex_unlock(&my_data->lock);
+    return ret;
+}
+
+static long at24c02_ioctl_bitops(struct at24c02_struct *my_data, unsigned long arg)
+{
+    struct at24c02_bitops data;
+    u8 *kbuf;
+    int ret;
+
+    if (copy_from_user(&data, (struct at24c02_bitops __user *)arg, sizeof(data)))
+    {
+        return -EFAULT;
+    }
+    if (data.address >= my_data->size)
+    {
+        return -EINVAL;
+    }
+
+    mutex_lock(&my_data->lock);
+    kbuf = at24c02_xfer_data(my_data);
+    ret = at24c02_read_locked(my_data, data.address, kbuf, 1);
+    if (!ret)
+    {
+        data.old = kbuf[0];
+        kbuf[0] = (data.old & ~data.clear) | data.set;
+        ret = at24c02_eeprom_update(my_data, data.address, kbuf, 1);
+    }
+    mutex_unlock(&my_data->lock);
+    if (ret)
+    {
+        return ret;
+    }
+
+    return copy_to_user((struct at24c02_bitops __user *)arg, &data, sizeof(data)) ? -EFAULT : 0;
+}
+
+static long at24c02_ioctl_add(struct at24c02_struct *my_data, unsigned long arg)
+{
+    struct at24c02_add data;
+    u8 le[8];
+    u8 *kbuf;
+    int ret;
+
+    if (copy_from_user(&data, (struct at24c02_add __user *)arg, sizeof(data)))
+    {
+        return -EFAULT;
+    }
+    if ((data.width != 1 && data.width != 2 && data.width != 4 && data.width != 8) ||
+        data.address + data.width > my_data->size)
+    {
+        return -EINVAL;
+    }
+
+    mutex_lock(&my_data->lock);
+    kbuf = at24c02_xfer_data(my_data);
+    ret = at24c02_read_locked(my_data, data.address, kbuf, data.width);
+    if (!ret)
+    {
+        // 按小端序拼出当前值, 加上增量后按宽度截断写回
+        memset(le, 0, sizeof(le));
+        memcpy(le, kbuf, data.width);
+        data.old = get_unaligned_le64(le);
+        put_unaligned_le64(data.old + data.delta, le);
+        memcpy(kbuf, le, data.width);
+        ret = at24c02_eeprom_update(my_data, data.address, kbuf, data.width);
+    }
+    mutex_unlock(&my_data->lock);
+    if (ret)
+    {
+        return ret;
+    }
+
+    return copy_to_user((struct at24c02_add __user *)arg, &data, sizeof(data)) ? -EFAULT : 0;
+}
+
+/*
+ * 异步写: 提交时把数据复制进有界队列后立即返回, 由工作项依次通过页写路径写入
+ * 队列排空或出错时唤醒 poll/AT24C02_SYNC 的等待者, 并通知注册的 eventfd
+ * 注意: 异步写在完成之前对读不可见, 需要读到新数据时先调用 AT24C02_SYNC
+ */
+static void at24c02_async_work(struct work_struct *work)
+{
+    struct at24c02_struct *my_data = container_of(work, struct at24c02_struct, async_work);
+    struct at24c02_async_req *req;
+    bool drained;
+    int ret;
+
+    for (;;)
+    {
+        spin_lock(&my_data->async_lock);
+        req = list_first_entry_or_null(&my_data->async_queue, struct at24c02_async_req, node);
+        if (req)
+        {
+            list_del(&req->node);
+        }
+        spin_unlock(&my_data->async_lock);
+        if (!req)
+        {
+            break;
+        }
+
+        // 暂存到传输缓冲区的数据区, 以便页写时在数据前插入字地址
+        mutex_lock(&my_data->lock);
+        memcpy(at24c02_xfer_data(my_data), req->data, req->len);
+        ret = at24c02_eeprom_write(my_data, req->address, at24c02_xfer_data(my_data), req->len);
+        mutex_unlock(&my_data->lock);
+        kfree(req);
+
+        spin_lock(&my_data->async_lock);
+        if (ret && !my_data->async_err)
+        {
+            my_data->async_err = ret;
+        }
+        my_data->async_pending--;
+        drained = !my_data->async_pending;
+        if (my_data->async_eventfd && (drained || ret))
+        {
+            eventfd_signal(my_data->async_eventfd, 1);
+        }
+        spin_unlock(&my_data->async_lock);
+
+        // 唤醒等待队列空间的提交者, 以及等待排空的 poll/AT24C02_SYNC
+        wake_up_interruptible(&my_data->async_waitq);
+    }
+}
+
+static long at24c02_ioctl_write_async(struct at24c02_struct *my_data, struct file *file, unsigned long arg)
+{
+    struct at24c02_io_data data;
+    struct at24c02_async_req *req;
+
+    if (copy_from_user(&data, (struct at24c02_io_data __user *)arg, sizeof(data)))
+    {
+        return -EFAULT;
+    }
+    if (data.address + data.len > my_data->size)
+    {
+        return -EINVAL;
+    }
+    if (!data.len)
+    {
+        return 0;
+    }
+
+    req = kmalloc(sizeof(*req) + data.len, GFP_KERNEL);
+    if (!req)
+    {
+        return -ENOMEM;
+    }
+    req->address = data.address;
+    req->len = data.len;
+    if (copy_from_user(req->data, data.buf, data.len))
+    {
+        kfree(req);
+        return -EFAULT;
+    }
 
-#include "at24c02_header.h"
+    // 队列已满时, 非阻塞模式直接返回 -EAGAIN, 否则等待工作项腾出空间
+    spin_lock(&my_data->async_lock);
+    while (my_data->async_pending >= AT24C02_ASYNC_DEPTH)
+    {
+        spin_unlock(&my_data->async_lock);
+        if (file->f_flags & O_NONBLOCK)
+        {
+            kfree(req);
+            return -EAGAIN;
+        }
+        if (wait_event_interruptible(my_data->async_waitq,
+                                     READ_ONCE(my_data->async_pending) < AT24C02_ASYNC_DEPTH))
+        {
+            kfree(req);
+            return -ERESTARTSYS;
+        }
+        spin_lock(&my_data->async_lock);
+    }
+    list_add_tail(&req->node, &my_data->async_queue);
+    my_data->async_pending++;
+    spin_unlock(&my_data->async_lock);
 
-// 全局的私有数据指针，通常在probe中分配并赋值给i2c_client的私有数据
-static struct at24c02_struct *g_at24c02_data;
+    schedule_work(&my_data->async_work);
+    return 0;
+}
 
-static int at24c02_open(struct inode *inode, struct file *file)
+// 等待所有已提交的异步写完成, 返回并清除此前记录的第一个错误
+static long at24c02_ioctl_sync(struct at24c02_struct *my_data)
 {
-    struct at24c02_struct *data = container_of(inode->i_cdev, struct at24c02_struct, cdev);
-    file->private_data = data;
-    pr_info("at24c02 device opened.\n");
-    return 0;
+    int ret;
+
+    if (wait_event_interruptible(my_data->async_waitq, !READ_ONCE(my_data->async_pending)))
+    {
+        return -ERESTARTSYS;
+    }
+
+    spin_lock(&my_data->async_lock);
+    ret = my_data->async_err;
+    my_data->async_err = 0;
+    spin_unlock(&my_data->async_lock);
+    return ret;
 }
 
-static int at24c02_release(struct inode *inode, struct file *file)
+// 注册完成通知用的 eventfd, 传入 -1 取消注册
+static long at24c02_ioctl_set_eventfd(struct at24c02_struct *my_data, unsigned long arg)
 {
-    pr_info("at24c02 device closed.\n");
+    struct eventfd_ctx *ctx = NULL;
+    struct eventfd_ctx *old;
+    int fd;
+
+    if (get_user(fd, (int __user *)arg))
+    {
+        return -EFAULT;
+    }
+    if (fd >= 0)
+    {
+        ctx = eventfd_ctx_fdget(fd);
+        if (IS_ERR(ctx))
+        {
+            return PTR_ERR(ctx);
+        }
+    }
+
+    spin_lock(&my_data->async_lock);
+    old = my_data->async_eventfd;
+    my_data->async_eventfd = ctx;
+    spin_unlock(&my_data->async_lock);
+
+    if (old)
+    {
+        eventfd_ctx_put(old);
+    }
     return 0;
 }
 
-static long at24c02_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+// 异步写队列排空时可写 (POLLOUT), 有未取走的错误时报告 POLLERR
+static unsigned int at24c02_poll(struct file *file, struct poll_table_struct *wait)
 {
-    int ret;
     struct at24c02_struct *my_data = file->private_data;
-    struct i2c_client *client = my_data->client;
-    struct at24c02_io_data data;
-    // 定义两个 I2C 消息，用于组合传输
-    struct i2c_msg msgs[2];
-    u8 *write_buf = NULL;
-    struct i2c_msg msg;
+    unsigned int mask = 0;
 
-    // 1. 从用户空间复制 ioctl 的参数结构体
-    // 这步是必需的，它将用户传入的结构体内容复制到内核栈上
-    if (copy_from_user(&data, (struct at24c02_io_data __user *)arg, sizeof(data)))
+    poll_wait(file, &my_data->async_waitq, wait);
+
+    spin_lock(&my_data->async_lock);
+    if (!my_data->async_pending)
     {
-        return -EFAULT;
+        mask |= POLLOUT | POLLWRNORM;
     }
-
-    // 2. 验证参数
-    // 确保地址和长度都在EEPROM的有效范围内 (AT24C02容量为256字节)
-    if (data.address + data.len > 256)
+    if (my_data->async_err)
     {
-        pr_err("Invalid address or length, exceeds device capacity.\n");
-        return -EINVAL;
+        mask |= POLLERR;
     }
+    spin_unlock(&my_data->async_lock);
+    return mask;
+}
+
+static long at24c02_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+    struct at24c02_struct *my_data = file->private_data;
 
     switch (cmd)
     {
     case AT24C02_RANDOM_READ:
+    case AT24C02_BYTE_WRITE:
+    case AT24C02_UPDATE:
+        return at24c02_ioctl_rw(my_data, cmd, arg);
+    case AT24C02_BATCH:
+        return at24c02_ioctl_batch(my_data, arg);
+    case AT24C02_WRITE_ASYNC:
+        return at24c02_ioctl_write_async(my_data, file, arg);
+    case AT24C02_SYNC:
+        return at24c02_ioctl_sync(my_data);
+    case AT24C02_SET_EVENTFD:
+        return at24c02_ioctl_set_eventfd(my_data, arg);
+    case AT24C02_CRC:
+        return at24c02_ioctl_crc(my_data, arg);
+    case AT24C02_WRITE_CRC:
+        return at24c02_ioctl_write_crc(my_data, arg);
+    case AT24C02_CMPXCHG:
+        return at24c02_ioctl_cmpxchg(my_data, arg);
+    case AT24C02_BITOPS:
+        return at24c02_ioctl_bitops(my_data, arg);
+    case AT24C02_ADD:
+        return at24c02_ioctl_add(my_data, arg);
+    case AT24C02_GET_STATS:
     {
-        // 消息1: 设置要读取的地址 (写操作)
-        msgs[0].addr = client->addr;
-        msgs[0].flags = 0; // 写操作标志
-        msgs[0].len = 1;
-        msgs[0].buf = (u8 *)&data.address;
+        struct at24c02_stats stats;
 
-        // 消息2: 从该地址读取数据 (读操作)
-        msgs[1].addr = client->addr;
-        msgs[1].flags = I2C_M_RD; // 读操作标志
-        msgs[1].len = data.len;
+        mutex_lock(&my_data->lock);
+        stats = my_data->stats;
+        mutex_unlock(&my_data->lock);
+        if (copy_to_user((struct at24c02_stats __user *)arg, &stats, sizeof(stats)))
+        {
+            return -EFAULT;
+        }
+        return 0;
+    }
+    case AT24C02_GET_INFO:
+    {
+        struct at24c02_info info = {
+            .size = my_data->size, .page_size = my_data->page_size, .addr_width = my_data->addr_width};
 
-        // 为读操作分配内核缓冲区
-        msgs[1].buf = kmalloc(data.len, GFP_KERNEL);
-        if (!msgs[1].buf)
+        if (copy_to_user((struct at24c02_info __user *)arg, &info, sizeof(info)))
         {
-            return -ENOMEM;
+            return -EFAULT;
         }
+        return 0;
+    }
+    default:
+        return -ENOTTY; // 无效命令
+    }
+}
 
-        // 执行组合传输
-        ret = i2c_transfer(client->adapter, msgs, 2);
-        if (ret != 2)
+static const struct file_operations at24c02_fops = {.owner = THIS_MODULE,
+                                                   .open = at24c02_open,
+                                                   .release = at24c02_release,
+                                                   .unlocked_ioctl = at24c02_ioctl,
+                                                   .poll = at24c02_poll};
+
+static void at24c02_hist_show(struct seq_file *m, const char *name, const struct at24c02_hist *hist)
+{
+    unsigned int i;
+
+    seq_printf(m, "%s (us):\n", name);
+    for (i = 0; i < AT24C02_HIST_BUCKETS; i++)
+    {
+        if (!hist->bucket[i])
         {
-            pr_err("I2C random read failed: %d\n", ret);
-            ret = -EIO;
+            continue;
         }
-        else
+        seq_printf(m, "  [%8lu, %8lu) %llu\n", i ? 1UL << (i - 1) : 0UL, 1UL << i,
+                   (unsigned long long)hist->bucket[i]);
+    }
+}
+
+// /sys/kernel/debug/at24c02/<设备名>/stats
+static int at24c02_stats_show(struct seq_file *m, void *unused)
+{
+    struct at24c02_struct *my_data = m->private;
+    u64 hits = atomic64_read(&my_data->cache_hits);
+    u64 misses = atomic64_read(&my_data->cache_misses);
+
+    mutex_lock(&my_data->lock);
+    seq_printf(m, "pages_written: %llu\n", (unsigned long long)my_data->stats.pages_written);
+    seq_printf(m, "pages_skipped: %llu\n", (unsigned long long)my_data->stats.pages_skipped);
+    seq_printf(m, "bytes_skipped: %llu\n", (unsigned long long)my_data->stats.bytes_skipped);
+    seq_printf(m, "xfer_errors: %llu\n", (unsigned long long)my_data->xfer_errors);
+    seq_printf(m, "cache_hits: %llu\n", (unsigned long long)hits);
+    seq_printf(m, "cache_misses: %llu\n", (unsigned long long)misses);
+    seq_printf(m, "cache_hit_ratio: %llu%%\n",
+               hits + misses ? (unsigned long long)div64_u64(hits * 100, hits + misses) : 0ULL);
+    at24c02_hist_show(m, "read_xfer", &my_data->hist_read);
+    at24c02_hist_show(m, "write_xfer", &my_data->hist_write);
+    at24c02_hist_show(m, "write_cycle", &my_data->hist_cycle);
+    mutex_unlock(&my_data->lock);
+    return 0;
+}
+
+static int at24c02_stats_open(struct inode *inode, struct file *file)
+{
+    return single_open(file, at24c02_stats_show, inode->i_private);
+}
+
+static const struct file_operations at24c02_stats_fops = {
+    .owner = THIS_MODULE, .open = at24c02_stats_open, .read = seq_read, .llseek = seq_lseek, .release = single_release};
+
+/*
+ * 确定芯片参数: compatible/i2c id 的匹配数据给出型号默认值,
+ * 设备树中的 size / pagesize / address-width (位数, 8 或 16) 可覆盖默认值
+ */
+static int at24c02_get_chip_info(struct at24c02_struct *my_data, const struct i2c_device_id *id)
+{
+    struct device *dev = &my_data->client->dev;
+    const struct at24c02_chip_info *chip;
+    u32 val;
+
+    chip = of_device_get_match_data(dev);
+    if (!chip && id)
+    {
+        chip = (const struct at24c02_chip_info *)id->driver_data;
+    }
+    if (!chip)
+    {
+        chip = &at24c02_chip_24c02;
+    }
+
+    my_data->size = chip->size;
+    my_data->page_size = chip->page_size;
+    my_data->addr_width = chip->addr_width;
+
+    if (!device_property_read_u32(dev, "size", &val))
+    {
+        my_data->size = val;
+    }
+    if (!device_property_read_u32(dev, "pagesize", &val))
+    {
+        my_data->page_size = val;
+    }
+    if (!device_property_read_u32(dev, "address-width", &val))
+    {
+        if (val != 8 && val != 16)
+        {
+            pr_err("Invalid address-width %u\n", val);
+            return -EINVAL;
+        }
+        my_data->addr_width = val / 8;
+    }
+
+    // 单字节寻址最多 8 个块 (从机地址低 3 位), 双字节寻址受 ioctl 的 __u16 地址限制
+    if (!my_data->size || my_data->size > AT24C02_MAX_SIZE ||
+        (my_data->addr_width == 1 && my_data->size > AT24C02_MAX_BLOCKS * AT24C02_BLOCK_SIZE))
+    {
+        pr_err("Invalid size %u\n", my_data->size);
+        return -EINVAL;
+    }
+    if (!is_power_of_2(my_data->page_size) || my_data->page_size > AT24C02_BLOCK_SIZE ||
+        my_data->page_size > my_data->size)
+    {
+        pr_err("Invalid pagesize %u\n", my_data->page_size);
+        return -EINVAL;
+    }
+
+    pr_info("at24c02: %u bytes, %u byte pages, %u byte addressing\n", my_data->size, my_data->page_size,
+            my_data->addr_width);
+    return 0;
+}
+
+/*
+ * 根据适配器能力选择最快的传输方式:
+ * 支持原生 I2C 时用任意长度的组合传输 (受 i2c_adapter_quirks 的长度限制),
+ * 否则退化为 SMBus I2C block (每次最多 32 字节), 最后才是逐字节 SMBus
+ */
+static int at24c02_setup_xfer(struct at24c02_struct *my_data)
+{
+    struct i2c_adapter *adapter = my_data->client->adapter;
+    const struct i2c_adapter_quirks *q = adapter->quirks;
+    static const char *const names[] = {"none", "i2c", "smbus-block", "smbus-byte"};
+
+    if (i2c_check_functionality(adapter, I2C_FUNC_I2C))
+    {
+        my_data->read_mode = AT24C02_XFER_I2C;
+        my_data->write_mode = AT24C02_XFER_I2C;
+        my_data->read_max = U16_MAX;
+        my_data->write_max = my_data->page_size;
+        if (q)
         {
-            // 成功后，将数据复制回用户空间
-            if (copy_to_user(data.buf, msgs[1].buf, data.len))
+            if (q->max_read_len)
             {
-                ret = -EFAULT;
+                my_data->read_max = min(my_data->read_max, q->max_read_len);
+            }
+            if (q->max_comb_2nd_msg_len)
+            {
+                my_data->read_max = min(my_data->read_max, q->max_comb_2nd_msg_len);
+            }
+            if (q->max_write_len)
+            {
+                if (q->max_write_len <= my_data->addr_width)
+                {
+                    pr_err("Adapter write limit too small\n");
+                    return -EOPNOTSUPP;
+                }
+                my_data->write_max = min_t(u16, my_data->write_max, q->max_write_len - my_data->addr_width);
             }
         }
-
-        kfree(msgs[1].buf);
-        return ret;
     }
-    case AT24C02_BYTE_WRITE:
+    else
     {
-        // 为写操作分配内核缓冲区，大小为地址（1字节）+ 数据长度
-        write_buf = kmalloc(data.len + 1, GFP_KERNEL);
-        if (!write_buf)
+        // SMBus 只能发送 1 字节的 command, 无法表达双字节字地址
+        if (my_data->addr_width != 1)
         {
-            return -ENOMEM;
+            pr_err("16-bit addressing needs a plain I2C adapter\n");
+            return -EOPNOTSUPP;
         }
 
-        // 第一个字节是EEPROM内部地址
-        write_buf[0] = (u8)data.address;
+        if (i2c_check_functionality(adapter, I2C_FUNC_SMBUS_READ_I2C_BLOCK))
+        {
+            my_data->read_mode = AT24C02_XFER_SMBUS_BLOCK;
+            my_data->read_max = I2C_SMBUS_BLOCK_MAX;
+        }
+        else if (i2c_check_functionality(adapter, I2C_FUNC_SMBUS_READ_BYTE_DATA))
+        {
+            my_data->read_mode = AT24C02_XFER_SMBUS_BYTE;
+            my_data->read_max = 1;
+        }
+        else
+        {
+            pr_err("Adapter supports neither I2C nor SMBus reads\n");
+            return -EOPNOTSUPP;
+        }
 
-        // 从用户空间复制数据到内核缓冲区
-        if (copy_from_user(&write_buf[1], data.buf, data.len))
+        if (i2c_check_functionality(adapter, I2C_FUNC_SMBUS_WRITE_I2C_BLOCK))
         {
-            kfree(write_buf);
-            return -EFAULT;
+            my_data->write_mode = AT24C02_XFER_SMBUS_BLOCK;
+            my_data->write_max = min_t(u16, my_data->page_size, I2C_SMBUS_BLOCK_MAX);
+        }
+        else if (i2c_check_functionality(adapter, I2C_FUNC_SMBUS_WRITE_BYTE_DATA))
+        {
+            my_data->write_mode = AT24C02_XFER_SMBUS_BYTE;
+            my_data->write_max = 1;
+        }
+        else
+        {
+            // 无法写入, 设备以只读方式工作
+            my_data->write_mode = AT24C02_XFER_NONE;
+            my_data->write_max = 0;
         }
+    }
 
-        // 准备 I2C 消息
-        msg.addr = client->addr;
-        msg.flags = 0; // 写操作
-        msg.len = data.len + 1;
-        msg.buf = write_buf;
+    pr_info("at24c02: read via %s (max %u), write via %s (max %u)\n", names[my_data->read_mode],
+            my_data->read_max, names[my_data->write_mode], my_data->write_max);
+    return 0;
+}
 
-        // 执行 I2C 传输
-        ret = i2c_transfer(client->adapter, &msg, 1);
-        if (ret != 1)
-        { // 期望1个消息成功
-            pr_err("I2C byte write failed: %d\n", ret);
-            ret = -EIO;
-        }
+// 注销 probe 时占用的其他块的从机地址, clients[0] 是设备本身, 不在这里释放
+static void at24c02_release_clients(struct at24c02_struct *my_data)
+{
+    unsigned int i;
 
-        kfree(write_buf);
-        // Must have 20ms delay for writing
-        mdelay(20);
-        return ret;
-    }
-    default:
-        return -ENOTTY; // 无效命令
+    for (i = 1; i < my_data->nr_clients; i++)
+    {
+        i2c_unregister_device(my_data->clients[i]);
     }
+    my_data->nr_clients = 1;
 }
 
-static const struct file_operations at24c02_fops = {
-    .owner = THIS_MODULE, .open = at24c02_open, .release = at24c02_release, .unlocked_ioctl = at24c02_ioctl};
+/*
+ * 24c04/08/16 的每个块占用一个从机地址, 逐个注册 dummy 从机占住这些地址,
+ * 避免其他驱动绑定到同一芯片的其他块上
+ */
+static int at24c02_claim_clients(struct at24c02_struct *my_data)
+{
+    struct i2c_client *client = my_data->client;
+    unsigned int nr = 1;
+
+    if (my_data->addr_width == 1)
+    {
+        nr = DIV_ROUND_UP(my_data->size, AT24C02_BLOCK_SIZE);
+    }
+
+    my_data->clients[0] = client;
+    for (my_data->nr_clients = 1; my_data->nr_clients < nr; my_data->nr_clients++)
+    {
+        my_data->clients[my_data->nr_clients] = i2c_new_dummy(client->adapter, client->addr + my_data->nr_clients);
+        if (!my_data->clients[my_data->nr_clients])
+        {
+            pr_err("Address 0x%02x unavailable\n", client->addr + my_data->nr_clients);
+            at24c02_release_clients(my_data);
+            return -EADDRINUSE;
+        }
+    }
+    return 0;
+}
 
 int at24c02_probe(struct i2c_client *client, const struct i2c_device_id *id)
 {
@@ -166,22 +1626,93 @@ int at24c02_probe(struct i2c_client *client, const struct i2c_device_id *id)
         pr_err("Failed to allocate private data for device\n");
         return -ENOMEM;
     }
-    g_at24c02_data = my_data;
 
     // 2. 将I2C客户端指针保存到私有数据中
     my_data->client = client;
+    mutex_init(&my_data->lock);
+
+    // 芯片参数: 先取型号默认值, 再用设备树属性覆盖
+    ret = at24c02_get_chip_info(my_data, id);
+    if (ret)
+    {
+        return ret;
+    }
+
+    // 按适配器能力选择传输方式
+    ret = at24c02_setup_xfer(my_data);
+    if (ret)
+    {
+        return ret;
+    }
+
+    // 预分配整片容量 + 字地址的传输缓冲区, ioctl/nvmem 读写均复用它
+    my_data->xfer_buf = devm_kmalloc(&client->dev, AT24C02_ADDR_LEN_MAX + my_data->size, GFP_KERNEL);
+    if (!my_data->xfer_buf)
+    {
+        pr_err("Failed to allocate transfer buffer\n");
+        return -ENOMEM;
+    }
+
+    // 批量 ioctl 工作区
+    my_data->batch_ents = devm_kcalloc(&client->dev, AT24C02_BATCH_MAX, sizeof(*my_data->batch_ents), GFP_KERNEL);
+    my_data->batch_spans = devm_kcalloc(&client->dev, AT24C02_BATCH_MAX, sizeof(*my_data->batch_spans), GFP_KERNEL);
+    my_data->batch_dirty =
+        devm_kcalloc(&client->dev, BITS_TO_LONGS(my_data->size), sizeof(unsigned long), GFP_KERNEL);
+    my_data->batch_page = devm_kmalloc(&client->dev, my_data->page_size, GFP_KERNEL);
+    if (!my_data->batch_ents || !my_data->batch_spans || !my_data->batch_dirty || !my_data->batch_page)
+    {
+        pr_err("Failed to allocate batch buffers\n");
+        return -ENOMEM;
+    }
+
+    // 比较写入的读回缓冲区
+    my_data->cmp_buf = devm_kmalloc(&client->dev, my_data->size, GFP_KERNEL);
+    if (!my_data->cmp_buf)
+    {
+        pr_err("Failed to allocate compare buffer\n");
+        return -ENOMEM;
+    }
+
+    // 异步写队列
+    INIT_LIST_HEAD(&my_data->async_queue);
+    spin_lock_init(&my_data->async_lock);
+    init_waitqueue_head(&my_data->async_waitq);
+    INIT_WORK(&my_data->async_work, at24c02_async_work);
+
+    // 后台预取
+    init_waitqueue_head(&my_data->prefetch_waitq);
+    INIT_WORK(&my_data->prefetch_work, at24c02_prefetch_work);
+
+    // 影子缓存, 初始全部无效
+    init_rwsem(&my_data->cache_lock);
+    my_data->cache = devm_kmalloc(&client->dev, my_data->size, GFP_KERNEL);
+    my_data->cache_valid =
+        devm_kcalloc(&client->dev, BITS_TO_LONGS(my_data->size), sizeof(unsigned long), GFP_KERNEL);
+    if (!my_data->cache || !my_data->cache_valid)
+    {
+        pr_err("Failed to allocate cache\n");
+        return -ENOMEM;
+    }
 
     // 3. 将私有数据附加到客户端上，这样可以在任何地方通过client->dev->driver_data获取
     i2c_set_clientdata(client, my_data);
 
-    // 4. 动态分配设备号
-    ret = alloc_chrdev_region(&my_data->dev_number, 0, 1, DEVICE_NAME);
-    if (ret < 0)
+    // 占用多块型号其他块的从机地址, 此后出错需要注销
+    ret = at24c02_claim_clients(my_data);
+    if (ret)
     {
-        pr_err("Failed to allocate major number\n");
         goto err_out; // 托管资源会自动清理
     }
 
+    // 4. 从模块的设备号段中分配次设备号
+    ret = ida_simple_get(&at24c02_minor_ida, 0, AT24C02_MAX_DEVICES, GFP_KERNEL);
+    if (ret < 0)
+    {
+        pr_err("Failed to allocate minor number\n");
+        goto err_release_clients;
+    }
+    my_data->dev_number = MKDEV(MAJOR(at24c02_devt), ret);
+
     // 5. 初始化并添加字符设备
     cdev_init(&my_data->cdev, &at24c02_fops);
     my_data->cdev.owner = THIS_MODULE;
@@ -189,36 +1720,63 @@ int at24c02_probe(struct i2c_client *client, const struct i2c_device_id *id)
     if (ret < 0)
     {
         pr_err("Failed to add character device\n");
-        goto err_unregister_dev;
+        goto err_remove_minor;
     }
 
-    // 6. 创建设备类
-    my_data->class = class_create(THIS_MODULE, CLASS_NAME);
-    if (IS_ERR(my_data->class))
+    // 6. 创建设备节点, 以总线号和从机地址命名, 例如 /dev/at24c02_0-0050
+    my_data->device = device_create(at24c02_class, &client->dev, my_data->dev_number, NULL, DEVICE_NAME_FMT,
+                                    i2c_adapter_id(client->adapter), client->addr);
+    if (IS_ERR(my_data->device))
     {
-        pr_err("Failed to create device class\n");
-        ret = PTR_ERR(my_data->class);
+        pr_err("Failed to create device node\n");
+        ret = PTR_ERR(my_data->device);
         goto err_cdev_del;
     }
 
-    // 7. 创建设备节点
-    my_data->device = device_create(my_data->class, &client->dev, my_data->dev_number, NULL, DEVICE_NAME);
-    if (IS_ERR(my_data->device))
+    // 7. 注册 nvmem provider, 读写回调与 ioctl 共用同一套传输函数
+    my_data->nvmem_config.name = dev_name(&client->dev);
+    my_data->nvmem_config.id = -1;
+    my_data->nvmem_config.dev = &client->dev;
+    my_data->nvmem_config.owner = THIS_MODULE;
+    my_data->nvmem_config.read_only = my_data->write_mode == AT24C02_XFER_NONE;
+    my_data->nvmem_config.root_only = true;
+    my_data->nvmem_config.reg_read = at24c02_nvmem_read;
+    my_data->nvmem_config.reg_write = at24c02_nvmem_write;
+    my_data->nvmem_config.priv = my_data;
+    my_data->nvmem_config.stride = 1;
+    my_data->nvmem_config.word_size = 1;
+    my_data->nvmem_config.size = my_data->size;
+
+    my_data->nvmem = nvmem_register(&my_data->nvmem_config);
+    if (IS_ERR(my_data->nvmem))
     {
-        pr_err("Failed to create device node\n");
-        ret = PTR_ERR(my_data->device);
-        goto err_class_destroy;
+        pr_err("Failed to register nvmem device\n");
+        ret = PTR_ERR(my_data->nvmem);
+        goto err_device_destroy;
+    }
+
+    // 8. 创建 debugfs 统计节点, 失败不影响驱动功能
+    my_data->debugfs = debugfs_create_dir(dev_name(my_data->device), at24c02_debugfs_root);
+    debugfs_create_file("stats", 0444, my_data->debugfs, my_data, &at24c02_stats_fops);
+
+    // 9. 启动后台预取, 不阻塞 probe
+    if (prefetch)
+    {
+        my_data->prefetching = true;
+        schedule_work(&my_data->prefetch_work);
     }
 
-    pr_info("at24c02 probe success. Device node created at /dev/%s\n", DEVICE_NAME);
+    pr_info("at24c02 probe success. Device node created at /dev/%s\n", dev_name(my_data->device));
     return 0;
 
-err_class_destroy:
-    class_destroy(my_data->class);
+err_device_destroy:
+    device_destroy(at24c02_class, my_data->dev_number);
 err_cdev_del:
     cdev_del(&my_data->cdev);
-err_unregister_dev:
-    unregister_chrdev_region(my_data->dev_number, 1);
+err_remove_minor:
+    ida_simple_remove(&at24c02_minor_ida, MINOR(my_data->dev_number));
+err_release_clients:
+    at24c02_release_clients(my_data);
 err_out:
     // devm_kzalloc 自动清理，这里无需kfree
     pr_err("at24c02_probe failed\n");
@@ -232,39 +1790,121 @@ int at24c02_remove(struct i2c_client *client)
 
     pr_info("at24c02_remove: Removing device at address 0x%x\n", client->addr);
 
-    // 2. 销毁设备节点
-    device_destroy(my_data->class, my_data->dev_number);
+    // 2. 停止后台预取, 注销 nvmem provider
+    cancel_work_sync(&my_data->prefetch_work);
+    my_data->prefetching = false;
+    wake_up_all(&my_data->prefetch_waitq);
+    debugfs_remove_recursive(my_data->debugfs);
+    nvmem_unregister(my_data->nvmem);
 
-    // 3. 销毁设备类
-    class_destroy(my_data->class);
+    // 3. 销毁设备节点
+    device_destroy(at24c02_class, my_data->dev_number);
 
     // 4. 删除字符设备
     cdev_del(&my_data->cdev);
 
-    // 5. 注销设备号
-    unregister_chrdev_region(my_data->dev_number, 1);
+    // 5. 等待已提交的异步写全部落盘, 释放 eventfd
+    flush_work(&my_data->async_work);
+    if (my_data->async_eventfd)
+    {
+        eventfd_ctx_put(my_data->async_eventfd);
+    }
+
+    // 6. 归还次设备号, 注销其他块的 dummy 从机
+    ida_simple_remove(&at24c02_minor_ida, MINOR(my_data->dev_number));
+    at24c02_release_clients(my_data);
 
-    // 6. 托管资源会自动释放，这里无需kfree
+    // 7. 托管资源会自动释放，这里无需kfree
 
     pr_info("at24c02_remove success.\n");
     return 0;
 }
 
 // 解决modpost错误，同时支持设备树和传统匹配，这是一种更健壮的方式
-static const struct i2c_device_id at24c02_id_table[] = {{COMPATIBLE_NAME, 0}, {}};
+// 设备树匹配时 i2c 核心以去掉厂商前缀的 compatible 作为 client 名称
+static const struct i2c_device_id at24c02_id_table[] = {
+    {"at24c02", (kernel_ulong_t)&at24c02_chip_24c02},   {"at24c04", (kernel_ulong_t)&at24c02_chip_24c04},
+    {"at24c08", (kernel_ulong_t)&at24c02_chip_24c08},   {"at24c16", (kernel_ulong_t)&at24c02_chip_24c16},
+    {"at24c32", (kernel_ulong_t)&at24c02_chip_24c32},   {"at24c64", (kernel_ulong_t)&at24c02_chip_24c64},
+    {"at24c128", (kernel_ulong_t)&at24c02_chip_24c128}, {"at24c256", (kernel_ulong_t)&at24c02_chip_24c256},
+    {"at24c512", (kernel_ulong_t)&at24c02_chip_24c512}, {}};
 MODULE_DEVICE_TABLE(i2c, at24c02_id_table);
 
-static const struct of_device_id at24c02_of_match[] = {{.compatible = COMPATIBLE_NAME}, {/* 哨兵 */}};
+static const struct of_device_id at24c02_of_match[] = {
+    {.compatible = COMPATIBLE_NAME, .data = &at24c02_chip_24c02},
+    {.compatible = "ccoisini,at24c04", .data = &at24c02_chip_24c04},
+    {.compatible = "ccoisini,at24c08", .data = &at24c02_chip_24c08},
+    {.compatible = "ccoisini,at24c16", .data = &at24c02_chip_24c16},
+    {.compatible = "ccoisini,at24c32", .data = &at24c02_chip_24c32},
+    {.compatible = "ccoisini,at24c64", .data = &at24c02_chip_24c64},
+    {.compatible = "ccoisini,at24c128", .data = &at24c02_chip_24c128},
+    {.compatible = "ccoisini,at24c256", .data = &at24c02_chip_24c256},
+    {.compatible = "ccoisini,at24c512", .data = &at24c02_chip_24c512},
+    {/* 哨兵 */}};
 
 static struct i2c_driver at24c02_driver = {
-    .driver = {.name = KBUILD_MODNAME, .owner = THIS_MODULE, .of_match_table = at24c02_of_match},
+    // 异步 probe: 多个 EEPROM 及其他设备的 probe 互不等待
+    .driver = {.name = KBUILD_MODNAME,
+               .owner = THIS_MODULE,
+               .of_match_table = at24c02_of_match,
+               .probe_type = PROBE_PREFER_ASYNCHRONOUS},
     .probe = at24c02_probe,
     .remove = at24c02_remove,
     // 如果不使用设备树，那么再自行添加.id_table
     .id_table = at24c02_id_table,
 };
 
-module_i2c_driver(at24c02_driver);
+static int __init at24c02_init(void)
+{
+    int ret;
+
+    // 1. 为所有实例一次性分配设备号段
+    ret = alloc_chrdev_region(&at24c02_devt, 0, AT24C02_MAX_DEVICES, DEVICE_NAME);
+    if (ret < 0)
+    {
+        pr_err("Failed to allocate major number\n");
+        return ret;
+    }
+
+    // 2. 创建设备类
+    at24c02_class = class_create(THIS_MODULE, CLASS_NAME);
+    if (IS_ERR(at24c02_class))
+    {
+        pr_err("Failed to create device class\n");
+        ret = PTR_ERR(at24c02_class);
+        goto err_unregister_dev;
+    }
+
+    // 3. debugfs 根目录, 失败不影响驱动功能
+    at24c02_debugfs_root = debugfs_create_dir(KBUILD_MODNAME, NULL);
+
+    // 4. 注册 I2C 驱动, 之后每个匹配的 client 都会调用一次 probe
+    ret = i2c_add_driver(&at24c02_driver);
+    if (ret)
+    {
+        goto err_debugfs_remove;
+    }
+    return 0;
+
+err_debugfs_remove:
+    debugfs_remove_recursive(at24c02_debugfs_root);
+    class_destroy(at24c02_class);
+err_unregister_dev:
+    unregister_chrdev_region(at24c02_devt, AT24C02_MAX_DEVICES);
+    return ret;
+}
+
+static void __exit at24c02_exit(void)
+{
+    i2c_del_driver(&at24c02_driver);
+    debugfs_remove_recursive(at24c02_debugfs_root);
+    class_destroy(at24c02_class);
+    unregister_chrdev_region(at24c02_devt, AT24C02_MAX_DEVICES);
+    ida_destroy(&at24c02_minor_ida);
+}
+
+module_init(at24c02_init);
+module_exit(at24c02_exit);
 MODULE_AUTHOR("CCoisini");
 MODULE_DESCRIPTION("This is a test driver");
 MODULE_LICENSE("GPL");
\ No newline at end of file
@@ -1,24 +1,60 @@
 #ifndef __AT24C02_HEADER_H__
 #define __AT24C02_HEADER_H__
 
+#include <linux/bitmap.h>
 #include <linux/cdev.h>
+#include <linux/crc16.h>
+#include <linux/crc32.h>
+#include <linux/debugfs.h>
 #include <linux/delay.h>
+#include <linux/eventfd.h>
 #include <linux/gpio.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
 #include <linux/gpio/consumer.h>
 #include <linux/i2c.h>
+#include <linux/idr.h>
 #include <linux/init.h>
 #include <linux/ioctl.h>
 #include <linux/kernel.h>
 #include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/nvmem-provider.h>
+#include <linux/of_device.h>
 #include <linux/platform_device.h>
+#include <linux/poll.h>
+#include <linux/property.h>
+#include <linux/rwsem.h>
+#include <linux/seq_file.h>
 #include <linux/slab.h>
+#include <linux/sort.h>
+#include <linux/spinlock.h>
 #include <linux/types.h>
 #include <linux/uaccess.h>
+#include <linux/workqueue.h>
+#include <asm/unaligned.h>
 
 #define DEVICE_NAME "at24c02_device"
+// 每个实例的设备节点名: 总线号-从机地址
+#define DEVICE_NAME_FMT "at24c02_%d-%04x"
+// 模块支持的最大 EEPROM 实例数
+#define AT24C02_MAX_DEVICES 16
 #define CLASS_NAME "at24c02_class"
 #define COMPATIBLE_NAME "ccoisini,at24c02"
 
+// AT24 系列: 容量/页大小/字地址宽度由 compatible 匹配数据或设备树属性决定
+// 页写不能跨页(否则页内地址回绕)
+// ioctl 的地址为 __u16, 因此最大支持 64 KiB (24c512)
+#define AT24C02_MAX_SIZE 65536
+// 字地址最多 2 字节 (24c32 及以上)
+#define AT24C02_ADDR_LEN_MAX 2
+// 单字节寻址时每个 I2C 从机地址覆盖的块大小, 24c04/08/16 用从机地址低位选块
+#define AT24C02_BLOCK_SIZE 256
+// 单字节寻址最多 8 个块 (从机地址低 3 位)
+#define AT24C02_MAX_BLOCKS 8
+// 每次页写之后芯片内部擦写周期所需的时间 (ms)
+#define AT24C02_WRITE_CYCLE_MS 20
+
 #define AT24C02_MAGIC 'E'
 
 // 定义一个通用的数据结构，用于在 ioctl 中传递地址、长度和数据
@@ -29,16 +65,244 @@ struct at24c02_io_data
     __u8 __user *buf; // 指向用户空间数据缓冲区的指针
 };
 
+// 批量操作: 一次系统调用提交多个读/写请求
+#define AT24C02_OP_READ 0
+#define AT24C02_OP_WRITE 1
+// 单次批量请求的最大条目数
+#define AT24C02_BATCH_MAX 64
+
+struct at24c02_batch_entry
+{
+    __u8 op;          // AT24C02_OP_READ / AT24C02_OP_WRITE
+    __u8 reserved;    // 保留, 置 0
+    __u16 address;    // EEPROM 内部的起始地址
+    __u16 len;        // 读或写的字节数
+    __u16 reserved2;  // 保留, 置 0
+    __s32 result;     // 输出: 0 表示成功, 否则为负的错误码
+    __u8 __user *buf; // 指向用户空间数据缓冲区的指针
+};
+
+// 条目按提交顺序生效: 读条目看到它之前所有写条目的结果, 看不到之后的写入.
+// 驱动按页合并写条目, 把读条目排序合并成最少的顺序读;
+// 某个写条目覆盖之前的读条目时, 在该处分阶段执行.
+// 返回 0 表示全部成功, 正数表示失败的条目个数 (具体见各条目 result)
+struct at24c02_batch
+{
+    __u32 count;                                 // 条目个数, 不超过 AT24C02_BATCH_MAX
+    struct at24c02_batch_entry __user *entries; // 条目数组
+};
+
+// 芯片参数, 由 AT24C02_GET_INFO 读取
+struct at24c02_info
+{
+    __u32 size;       // 容量 (字节)
+    __u16 page_size;  // 页大小 (字节)
+    __u8 addr_width;  // 字地址字节数, 1 或 2
+    __u8 reserved;
+};
+
+// 写入统计, 由 AT24C02_GET_STATS 读取
+struct at24c02_stats
+{
+    __u64 pages_written; // 实际执行的页写次数
+    __u64 pages_skipped; // 内容未变化而跳过的页数
+    __u64 bytes_skipped; // 内容未变化而未写入的字节数
+};
+
+// 校验算法
+#define AT24C02_CRC32 0 // CRC-32 (IEEE 802.3), 与 zlib crc32() 一致
+#define AT24C02_CRC16 1 // CRC-16/ARC (多项式 0x8005 反射, 初值 0)
+// AT24C02_CRC 的 flags: 与 expected 比较, 不一致时返回 -EBADMSG
+#define AT24C02_CRC_F_COMPARE 0x01
+// AT24C02_CRC 的 flags: 不使用影子缓存, 从芯片读出后计算 (用于写后校验)
+#define AT24C02_CRC_F_NOCACHE 0x02
+
+// 在驱动内计算区间校验值, 只把结果返回用户空间
+struct at24c02_crc_data
+{
+    __u16 address;  // EEPROM 内部的起始地址
+    __u16 len;      // 参与计算的字节数
+    __u8 type;      // AT24C02_CRC32 / AT24C02_CRC16
+    __u8 flags;     // AT24C02_CRC_F_*
+    __u16 reserved; // 保留, 置 0
+    __u32 expected; // 输入: 期望的校验值
+    __u32 crc;      // 输出: 计算得到的校验值
+};
+
+// 写入数据并在其后追加小端序校验值 (CRC32 4 字节 / CRC16 2 字节), 写后读回校验
+struct at24c02_crc_write
+{
+    __u16 address;    // EEPROM 内部的起始地址
+    __u16 len;        // 数据字节数, 不含校验值
+    __u8 type;        // AT24C02_CRC32 / AT24C02_CRC16
+    __u8 reserved[3]; // 保留, 置 0
+    __u8 __user *buf; // 指向用户空间数据缓冲区的指针
+};
+
+// 原子读-改-写, 均在设备锁内完成, 只写入发生变化的页
+// 比较并交换: 当前内容等于 expected 时写入 desired,
+// 否则把当前内容写回 expected 并返回 -EAGAIN
+struct at24c02_cmpxchg
+{
+    __u16 address;         // EEPROM 内部的起始地址
+    __u16 len;             // 比较/写入的字节数
+    __u8 __user *expected; // 期望的当前内容 (失败时输出实际内容)
+    __u8 __user *desired;  // 要写入的新内容
+};
+
+// 位操作: new = (old & ~clear) | set
+struct at24c02_bitops
+{
+    __u16 address;     // EEPROM 内部地址
+    __u8 set;          // 要置位的位
+    __u8 clear;        // 要清零的位
+    __u8 old;          // 输出: 修改前的值
+    __u8 reserved[3];  // 保留, 置 0
+};
+
+// 小端计数器加法, 按宽度回绕
+struct at24c02_add
+{
+    __u16 address;    // EEPROM 内部地址
+    __u8 width;       // 计数器宽度: 1/2/4/8 字节
+    __u8 reserved[5]; // 保留, 置 0
+    __s64 delta;      // 增量, 可为负
+    __u64 old;        // 输出: 修改前的值
+};
+
 #define AT24C02_RANDOM_READ _IOWR(AT24C02_MAGIC, 1, struct at24c02_io_data)
 #define AT24C02_BYTE_WRITE _IOW(AT24C02_MAGIC, 2, struct at24c02_io_data)
+#define AT24C02_BATCH _IOWR(AT24C02_MAGIC, 3, struct at24c02_batch)
+// 与 AT24C02_BYTE_WRITE 相同, 但先与芯片当前内容比较, 只写入发生变化的页
+#define AT24C02_UPDATE _IOW(AT24C02_MAGIC, 4, struct at24c02_io_data)
+#define AT24C02_GET_STATS _IOR(AT24C02_MAGIC, 5, struct at24c02_stats)
+#define AT24C02_GET_INFO _IOR(AT24C02_MAGIC, 6, struct at24c02_info)
+// 异步写: 数据进入内核队列后立即返回, 完成前对读不可见
+// 队列满时阻塞, O_NONBLOCK 下返回 -EAGAIN
+#define AT24C02_WRITE_ASYNC _IOW(AT24C02_MAGIC, 7, struct at24c02_io_data)
+// 等待全部异步写完成, 返回并清除此前的第一个错误
+#define AT24C02_SYNC _IO(AT24C02_MAGIC, 8)
+// 注册 eventfd, 异步写队列排空或出错时计数加一; 传入 -1 取消
+#define AT24C02_SET_EVENTFD _IOW(AT24C02_MAGIC, 9, int)
+#define AT24C02_CRC _IOWR(AT24C02_MAGIC, 10, struct at24c02_crc_data)
+#define AT24C02_WRITE_CRC _IOW(AT24C02_MAGIC, 11, struct at24c02_crc_write)
+#define AT24C02_CMPXCHG _IOW(AT24C02_MAGIC, 12, struct at24c02_cmpxchg)
+#define AT24C02_BITOPS _IOWR(AT24C02_MAGIC, 13, struct at24c02_bitops)
+#define AT24C02_ADD _IOWR(AT24C02_MAGIC, 14, struct at24c02_add)
+
+// 比较并交换时从用户空间分块读取 expected 的块大小
+#define AT24C02_CMPXCHG_CHUNK 32
+
+// 后台预取每次持有总线锁读取的字节数
+#define AT24C02_PREFETCH_CHUNK 256
+
+// log2 延迟直方图的桶数, 第 i 个桶统计 [2^(i-1), 2^i) 微秒
+#define AT24C02_HIST_BUCKETS 24
+
+struct at24c02_hist
+{
+    u64 bucket[AT24C02_HIST_BUCKETS];
+};
+
+// 异步写队列的最大深度 (请求数)
+#define AT24C02_ASYNC_DEPTH 32
+
+// 一个排队中的异步写请求
+struct at24c02_async_req
+{
+    struct list_head node;
+    u16 address;
+    u16 len;
+    u8 data[];
+};
+
+// 批量读合并时允许跨越的最大空洞, 小于一次地址建立的开销
+#define AT24C02_BATCH_MERGE_GAP 4
+
+// 批量读排序用: 一个读条目的区间及其在条目数组中的下标
+struct at24c02_batch_span
+{
+    u32 start;
+    u32 end;
+    u32 index;
+};
+
+// 传输方式, 由 probe 时适配器的能力决定
+enum at24c02_xfer_mode
+{
+    AT24C02_XFER_NONE,        // 不支持 (仅用于写: 只读设备)
+    AT24C02_XFER_I2C,         // 原生 I2C 消息
+    AT24C02_XFER_SMBUS_BLOCK, // SMBus I2C block, 每次最多 32 字节
+    AT24C02_XFER_SMBUS_BYTE,  // SMBus 逐字节
+};
+
+// 各型号的默认参数, 作为 of_device_id / i2c_device_id 的匹配数据
+struct at24c02_chip_info
+{
+    u32 size;
+    u16 page_size;
+    u8 addr_width;
+};
 
 struct at24c02_struct
 {
     dev_t dev_number;
-    struct class *class;
     struct cdev cdev;
     struct device *device;
     struct i2c_client *client;
+    // 每个块对应的从机, clients[0] 即 client, 其余是 probe 时占用的 dummy 从机
+    struct i2c_client *clients[AT24C02_MAX_BLOCKS];
+    unsigned int nr_clients;
+    // 芯片参数
+    u32 size;
+    u16 page_size;
+    u8 addr_width;
+    // 传输方式及单次传输的最大数据长度
+    u8 read_mode;
+    u8 write_mode;
+    u16 read_max;
+    u16 write_max;
+    // 串行化所有 I2C 访问 (ioctl 与 nvmem 回调共用), 也是修改缓存的前提
+    struct mutex lock;
+    // 影子缓存及其有效位图, 由 cache_lock 保护
+    struct rw_semaphore cache_lock;
+    u8 *cache;
+    unsigned long *cache_valid;
+    // 预分配的传输缓冲区 (kmalloc 分配, 可用于 DMA), 受 lock 保护
+    // 布局: [字地址 AT24C02_ADDR_LEN_MAX 字节][数据区 size 字节]
+    u8 *xfer_buf;
+    // 批量 ioctl 的预分配工作区, 同样受 lock 保护
+    struct at24c02_batch_entry *batch_ents;
+    struct at24c02_batch_span *batch_spans;
+    unsigned long *batch_dirty; // 写镜像中被批量写条目覆盖的字节
+    u8 *batch_page;             // 补齐页内空洞时的页读缓冲区
+    // 比较写入时读回的芯片当前内容, 受 lock 保护
+    u8 *cmp_buf;
+    struct at24c02_stats stats;
+    // 异步写队列, async_pending 包括正在执行的请求, 均由 async_lock 保护
+    spinlock_t async_lock;
+    struct list_head async_queue;
+    unsigned int async_pending;
+    int async_err;
+    wait_queue_head_t async_waitq;
+    struct work_struct async_work;
+    struct eventfd_ctx *async_eventfd;
+    // debugfs 统计: 直方图和错误计数由 lock 保护, 缓存命中计数无锁更新
+    struct dentry *debugfs;
+    struct at24c02_hist hist_read;
+    struct at24c02_hist hist_write;
+    struct at24c02_hist hist_cycle;
+    u64 xfer_errors;
+    atomic64_t cache_hits;
+    atomic64_t cache_misses;
+    // 后台预取: prefetch_pos 之前的内容已进入缓存
+    struct work_struct prefetch_work;
+    wait_queue_head_t prefetch_waitq;
+    unsigned int prefetch_pos;
+    bool prefetching;
+    // nvmem provider, 供内核 consumer 及 sysfs nvmem 节点使用
+    struct nvmem_config nvmem_config;
+    struct nvmem_device *nvmem;
 };
 
 #endif
\ No newline at end of file
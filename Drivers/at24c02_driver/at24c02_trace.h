@@ -0,0 +1,37 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM at24c02
+
+#if !defined(__AT24C02_TRACE_H__) || defined(TRACE_HEADER_MULTI_READ)
+#define __AT24C02_TRACE_H__
+
+#include <linux/tracepoint.h>
+
+// 每次 I2C/SMBus 传输: 方向、芯片内偏移、长度、结果和耗时
+TRACE_EVENT(at24c02_xfer,
+            TP_PROTO(int bus, u16 addr, bool write, unsigned int offset, unsigned int len, int ret, u64 duration_ns),
+            TP_ARGS(bus, addr, write, offset, len, ret, duration_ns),
+            TP_STRUCT__entry(__field(int, bus) __field(u16, addr) __field(bool, write) __field(unsigned int, offset)
+                                 __field(unsigned int, len) __field(int, ret) __field(u64, duration_ns)),
+            TP_fast_assign(__entry->bus = bus; __entry->addr = addr; __entry->write = write; __entry->offset = offset;
+                           __entry->len = len; __entry->ret = ret; __entry->duration_ns = duration_ns;),
+            TP_printk("%d-%04x %s offset=0x%x len=%u ret=%d duration=%lluns", __entry->bus, __entry->addr,
+                      __entry->write ? "write" : "read", __entry->offset, __entry->len, __entry->ret,
+                      (unsigned long long)__entry->duration_ns));
+
+// 页写之后等待芯片内部写周期的实际时间
+TRACE_EVENT(at24c02_write_cycle, TP_PROTO(int bus, u16 addr, unsigned int offset, u64 wait_ns),
+            TP_ARGS(bus, addr, offset, wait_ns),
+            TP_STRUCT__entry(__field(int, bus) __field(u16, addr) __field(unsigned int, offset) __field(u64, wait_ns)),
+            TP_fast_assign(__entry->bus = bus; __entry->addr = addr; __entry->offset = offset;
+                           __entry->wait_ns = wait_ns;),
+            TP_printk("%d-%04x offset=0x%x wait=%lluns", __entry->bus, __entry->addr, __entry->offset,
+                      (unsigned long long)__entry->wait_ns));
+
+#endif
+
+// 本头文件不在内核的 include/trace/events 下, 需从驱动目录包含 (见 Makefile)
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE at24c02_trace
+#include <trace/define_trace.h>
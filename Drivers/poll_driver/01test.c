@@ -1,120 +1,1530 @@
 #include "linux/printk.h"
 #include "linux/wait.h"
 #include <linux/cdev.h>
+#include <linux/cpumask.h>
 #include <linux/device.h>
 #include <linux/fs.h>
 #include <linux/init.h>
 #include <linux/kernel.h>
+#include <linux/kfifo.h>
+#include <linux/ktime.h>
+#include <linux/mm.h>
 #include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/nodemask.h>
+#include <linux/percpu.h>
 #include <linux/poll.h>
+#include <linux/scatterlist.h>
+#include <linux/slab.h>
+#include <linux/uio.h>
+#include <linux/vmalloc.h>
+
+#include "mydevice_header.h"
 
 #define DEVICE_NAME "mydevice"
 #define CLASS_NAME "myclass"
+#define MYDEVICE_MAX_CHANNELS 64
+
+// 通道数, 每个通道是一个独立的 /dev/mydeviceN
+static unsigned int nr_channels = 1;
+module_param(nr_channels, uint, 0444);
+MODULE_PARM_DESC(nr_channels, "Number of independent channels (/dev/mydevice0..N-1)");
+
+// FIFO 容量 (字节), kfifo 会向上取整到 2 的幂
+static unsigned int fifo_size = 4096;
+module_param(fifo_size, uint, 0444);
+MODULE_PARM_DESC(fifo_size, "FIFO size in bytes, rounded up to a power of two");
+
+// FIFO 模式的水位: 数据不少于 rx_low 字节才可读, 空闲超过 tx_low 字节才可写
+// 只在跨过水位时唤醒, 把逐字节的唤醒合并成批量唤醒
+static unsigned int rx_low = 1;
+module_param(rx_low, uint, 0444);
+MODULE_PARM_DESC(rx_low, "Bytes that must be queued before readers are woken");
+static unsigned int tx_low;
+module_param(tx_low, uint, 0444);
+MODULE_PARM_DESC(tx_low, "Free bytes that must be exceeded before writers are woken");
+
+// 单生产者/单消费者无锁环形缓冲区模式, 只允许一个读者和一个写者
+static bool spsc;
+module_param(spsc, bool, 0444);
+MODULE_PARM_DESC(spsc, "Lock-free single-producer/single-consumer ring mode");
+
+// 广播模式: 写入一次, 每个读者按自己的游标读到全部数据
+static bool broadcast;
+module_param(broadcast, bool, 0444);
+MODULE_PARM_DESC(broadcast, "Broadcast every write to all readers");
+
+// 每 CPU 缓冲区模式: 写者只写本 CPU 的缓冲区, 读者合并所有 CPU 的数据
+static bool percpu;
+module_param(percpu, bool, 0444);
+MODULE_PARM_DESC(percpu, "Per-CPU producer buffers merged on read");
+
+// 消息模式: 每次 write 是一条带长度前缀的记录, read 只返回完整的记录
+static bool message;
+module_param(message, bool, 0444);
+MODULE_PARM_DESC(message, "Record-framed message mode");
+// 消息模式下单条消息的上限, 空闲空间放得下一条最大消息才报告可写
+static unsigned int msg_max = 256;
+module_param(msg_max, uint, 0444);
+MODULE_PARM_DESC(msg_max, "Largest message in message mode; POLLOUT needs room for one");
 
 int major;
 struct class *myclass;
 struct cdev mycdev;
-static int ready_to_read = 0;
-static int ready_to_write = 0;
 
-static DECLARE_WAIT_QUEUE_HEAD(my_wq);
-static DECLARE_WAIT_QUEUE_HEAD(my_rq);
+/*
+ * SPSC 环形缓冲区: head 只由写者推进, tail 只由读者推进, 两者分处不同缓存行.
+ * 发布数据用 smp_store_release, 读取对方下标用 smp_load_acquire, 数据路径不加锁.
+ * 只在 空->非空 和 满->非满 时唤醒, 推进下标后的 smp_mb() 与 wait_event
+ * 中 set_current_state() 的屏障配对, 保证不会丢失唤醒.
+ * 控制页和数据区一起用 vmalloc_user 分配, 可整体 mmap 给用户空间直接读写;
+ * 用户空间可以改写 head/tail, 所以内核只信任自己保存的 mask.
+ */
+struct mydevice_spsc
+{
+    struct mydevice_ring_ctrl *ctrl;
+    char *buf;
+    unsigned int mask;
+};
+
+// 读者/写者角色在第一次 read/write 或门铃 ioctl 时认领, 记录在打开文件的上下文中
+#define SPSC_READER 0
+#define SPSC_WRITER 1
+
+/*
+ * 广播环形缓冲区: 写者在通道锁下覆盖最旧的数据并推进 head, 从不阻塞;
+ * 每个读者有自己的游标, 落后超过缓冲区大小时丢失的数据无法找回,
+ * 该次读取返回 -EOVERFLOW 并把游标移到仍保留的最旧数据处.
+ */
+struct mydevice_bcast
+{
+    char *buf;
+    unsigned int mask;
+    unsigned int head;
+};
+
+/*
+ * 每 CPU 缓冲区: 每次 write 在当前 CPU 的缓冲区追加一条 [时间戳][长度][数据] 记录.
+ * 同一 CPU 上的写者之间用 wlock 互斥, 与读者之间按 SPSC 方式用 acquire/release
+ * 交接 head/tail, 不同 CPU 的写者互不干扰. 读者持通道锁按轮转或时间戳顺序合并,
+ * 记录可以被分几次读完, 未读完的记录 (partial_cpu) 总是优先继续读.
+ */
+struct mydevice_pcpu
+{
+    struct mutex wlock;
+    char *buf;
+    unsigned int mask;
+    unsigned int rd_off; // 当前记录已被读走的数据字节数, 受通道锁保护
+    unsigned int head ____cacheline_aligned_in_smp;
+    unsigned int tail ____cacheline_aligned_in_smp;
+};
+
+struct mydevice_pcpu_hdr
+{
+    u64 ts;
+    u32 len;
+} __packed;
+
+#define PCPU_HDR_LEN sizeof(struct mydevice_pcpu_hdr)
+
+/*
+ * 每个通道有自己的缓冲区、锁和等待队列, 互不相关的生产者/消费者对不会争用.
+ * 通道结构按缓存行对齐, 连同缓冲区一起分配在按通道序号轮流选取的在线 NUMA 节点上.
+ */
+struct mydevice_channel
+{
+    // 字节 FIFO: 写入入队, 读取出队; my_lock 串行化 kfifo 的拷贝
+    struct kfifo my_fifo;
+    struct mutex my_lock;
+    // my_wq: 等待 FIFO 有空间的写者; my_rq: 等待 FIFO 有数据的读者
+    // FIFO 模式下阻塞的读者和写者都是独占等待, 一次唤醒只叫醒一个, 避免惊群;
+    // poll/select 的等待项不是独占的, epoll 可用 EPOLLEXCLUSIVE 获得同样效果
+    wait_queue_head_t my_wq;
+    wait_queue_head_t my_rq;
+    struct mydevice_spsc my_ring;
+    unsigned long spsc_owners;
+    struct mydevice_bcast my_bcast;
+    struct mydevice_pcpu __percpu *pcpu;
+    int partial_cpu;
+    // 消息模式: 2 字节长度前缀的记录 FIFO, 计数受 my_lock 保护
+    struct kfifo_rec_ptr_2 my_msgs;
+    // FIFO 或消息模式下 kfifo 使用的缓冲区, 按节点分配后交给 kfifo_init
+    void *fifo_buf;
+    unsigned int msg_count;
+    unsigned int msg_bytes;
+} ____cacheline_aligned_in_smp;
+
+static struct mydevice_channel **channels;
+
+// 每次 open 分配的上下文, 保存在 file->private_data
+struct mydevice_file
+{
+    struct mydevice_channel *ch;
+    unsigned long roles; // SPSC 模式下认领的角色
+    unsigned int pos;    // 广播模式下本读者的游标
+    int order;           // 每 CPU 模式下的合并顺序, MYDEVICE_ORDER_*
+    int rr_cpu;          // 轮转合并时上一次读取的 CPU
+};
+
+static inline struct mydevice_channel *mydevice_chan(struct file *file)
+{
+    return ((struct mydevice_file *)file->private_data)->ch;
+}
 
 static int mydevice_open(struct inode *inode, struct file *file)
 {
+    struct mydevice_file *ctx;
+    unsigned int minor = iminor(inode);
+
     // 打开设备实现
     pr_info("Open is triggered\n");
+    if (minor >= nr_channels)
+    {
+        return -ENODEV;
+    }
+    ctx = kzalloc(sizeof(*ctx), GFP_KERNEL);
+    if (!ctx)
+    {
+        return -ENOMEM;
+    }
+    ctx->ch = channels[minor];
+    ctx->rr_cpu = -1;
+    // 广播模式下新读者只接收打开之后写入的数据
+    ctx->pos = READ_ONCE(ctx->ch->my_bcast.head);
+    file->private_data = ctx;
     return 0;
 }
 
 static int mydevice_release(struct inode *inode, struct file *file)
 {
-    // 关闭设备实现
+    struct mydevice_file *ctx = file->private_data;
+
+    // 关闭设备实现, 交还本文件认领的 SPSC 角色
+    if (ctx->roles & BIT(SPSC_READER))
+    {
+        clear_bit(SPSC_READER, &ctx->ch->spsc_owners);
+    }
+    if (ctx->roles & BIT(SPSC_WRITER))
+    {
+        clear_bit(SPSC_WRITER, &ctx->ch->spsc_owners);
+    }
+    kfree(ctx);
     return 0;
 }
 
-static ssize_t mydevice_read(struct file *file, char __user *buf, size_t len, loff_t *offset)
+// SPSC 模式下读者和写者各只能有一个, 被其他文件占用时返回 -EBUSY
+static int mydevice_spsc_claim(struct file *file, int role)
 {
-    // 读取设备实现
+    struct mydevice_file *ctx = file->private_data;
+
+    if (ctx->roles & BIT(role))
+    {
+        return 0;
+    }
+    if (test_and_set_bit(role, &ctx->ch->spsc_owners))
+    {
+        return -EBUSY;
+    }
+    ctx->roles |= BIT(role);
     return 0;
 }
 
-static ssize_t mydevice_write(struct file *file, const char __user *buf, size_t len, loff_t *offset)
+static inline unsigned int mydevice_spsc_used(struct mydevice_channel *ch)
+{
+    return smp_load_acquire(&ch->my_ring.ctrl->head) - smp_load_acquire(&ch->my_ring.ctrl->tail);
+}
+
+/*
+ * 环形缓冲区与 iov_iter 之间的拷贝, 跨过末尾时分两段. 目标可以是 readv/writev 的
+ * 多段用户缓冲区, 也可以是 splice 的管道页, 返回值小于 n 说明遇到了错误地址
+ * 或管道已满.
+ */
+static size_t mydevice_ring_to_iter(const char *buf, unsigned int mask, unsigned int pos, size_t n,
+                                    struct iov_iter *to)
+{
+    unsigned int off = pos & mask;
+    size_t first = min_t(size_t, n, mask + 1 - off);
+    size_t copied = copy_to_iter(buf + off, first, to);
+
+    if (copied == first && n > first)
+    {
+        copied += copy_to_iter(buf, n - first, to);
+    }
+    return copied;
+}
+
+static size_t mydevice_iter_to_ring(char *buf, unsigned int mask, unsigned int pos, size_t n,
+                                    struct iov_iter *from)
+{
+    unsigned int off = pos & mask;
+    size_t first = min_t(size_t, n, mask + 1 - off);
+    size_t copied = copy_from_iter(buf + off, first, from);
+
+    if (copied == first && n > first)
+    {
+        copied += copy_from_iter(buf, n - first, from);
+    }
+    return copied;
+}
+
+// kfifo 的 DMA 接口给出缓冲区中连续的一到两段, 逐段与 iov_iter 拷贝, 遇到错误即停止
+static unsigned int mydevice_sg_to_iter(struct scatterlist *sg, unsigned int nents, struct iov_iter *to)
+{
+    unsigned int i, n, copied = 0;
+
+    for (i = 0; i < nents; i++)
+    {
+        n = copy_to_iter(sg_virt(&sg[i]), sg[i].length, to);
+        copied += n;
+        if (n != sg[i].length)
+        {
+            break;
+        }
+    }
+    return copied;
+}
+
+static unsigned int mydevice_iter_to_sg(struct scatterlist *sg, unsigned int nents, struct iov_iter *from)
+{
+    unsigned int i, n, copied = 0;
+
+    for (i = 0; i < nents; i++)
+    {
+        n = copy_from_iter(sg_virt(&sg[i]), sg[i].length, from);
+        copied += n;
+        if (n != sg[i].length)
+        {
+            break;
+        }
+    }
+    return copied;
+}
+
+// 字节 FIFO 与 iov_iter 之间的拷贝, 调用者持有通道锁
+static unsigned int mydevice_fifo_to_iter(struct kfifo *fifo, struct iov_iter *to)
+{
+    struct scatterlist sg[2];
+    unsigned int nents, copied;
+
+    sg_init_table(sg, ARRAY_SIZE(sg));
+    nents = kfifo_dma_out_prepare(fifo, sg, ARRAY_SIZE(sg), min_t(size_t, iov_iter_count(to), UINT_MAX));
+    copied = mydevice_sg_to_iter(sg, nents, to);
+    kfifo_dma_out_finish(fifo, copied);
+    return copied;
+}
+
+static unsigned int mydevice_iter_to_fifo(struct kfifo *fifo, struct iov_iter *from)
+{
+    struct scatterlist sg[2];
+    unsigned int nents, copied;
+
+    sg_init_table(sg, ARRAY_SIZE(sg));
+    nents = kfifo_dma_in_prepare(fifo, sg, ARRAY_SIZE(sg), min_t(size_t, iov_iter_count(from), UINT_MAX));
+    copied = mydevice_iter_to_sg(sg, nents, from);
+    kfifo_dma_in_finish(fifo, copied);
+    return copied;
+}
+
+static ssize_t mydevice_spsc_read(struct file *file, struct iov_iter *to)
+{
+    struct mydevice_channel *ch = mydevice_chan(file);
+    unsigned int head, tail, n;
+    int ret;
+
+    ret = mydevice_spsc_claim(file, SPSC_READER);
+    if (ret)
+    {
+        return ret;
+    }
+
+    // 1. tail 只有本读者修改, 直接读取; head 需要 acquire 才能看到写者的数据
+    tail = READ_ONCE(ch->my_ring.ctrl->tail);
+    for (;;)
+    {
+        head = smp_load_acquire(&ch->my_ring.ctrl->head);
+        if (head != tail)
+        {
+            break;
+        }
+        if (file->f_flags & O_NONBLOCK)
+        {
+            return -EAGAIN;
+        }
+        ret = wait_event_interruptible(ch->my_rq, smp_load_acquire(&ch->my_ring.ctrl->head) != tail);
+        if (ret)
+        {
+            return ret;
+        }
+    }
+    if (head - tail > ch->my_ring.mask + 1)
+    {
+        return -EIO;
+    }
+
+    // 2. 拷贝时可能绕回缓冲区开头, 分两段; 只拷了一部分时按实际长度推进
+    n = mydevice_ring_to_iter(ch->my_ring.buf, ch->my_ring.mask, tail,
+                              min_t(size_t, iov_iter_count(to), head - tail), to);
+    if (!n)
+    {
+        return -EFAULT;
+    }
+
+    // 3. 数据拷完再发布 tail, 缓冲区从满变为非满时才唤醒写者
+    smp_store_release(&ch->my_ring.ctrl->tail, tail + n);
+    smp_mb();
+    if (READ_ONCE(ch->my_ring.ctrl->head) - tail == ch->my_ring.mask + 1)
+    {
+        wake_up_interruptible(&ch->my_wq);
+    }
+    return n;
+}
+
+static ssize_t mydevice_spsc_write(struct file *file, struct iov_iter *from)
+{
+    struct mydevice_channel *ch = mydevice_chan(file);
+    unsigned int head, tail, n;
+    int ret;
+
+    ret = mydevice_spsc_claim(file, SPSC_WRITER);
+    if (ret)
+    {
+        return ret;
+    }
+
+    // 1. head 只有本写者修改, tail 需要 acquire 保证读者已经拷走数据
+    head = READ_ONCE(ch->my_ring.ctrl->head);
+    for (;;)
+    {
+        tail = smp_load_acquire(&ch->my_ring.ctrl->tail);
+        if (head - tail != ch->my_ring.mask + 1)
+        {
+            break;
+        }
+        if (file->f_flags & O_NONBLOCK)
+        {
+            return -EAGAIN;
+        }
+        ret = wait_event_interruptible(ch->my_wq,
+                                       head - smp_load_acquire(&ch->my_ring.ctrl->tail) != ch->my_ring.mask + 1);
+        if (ret)
+        {
+            return ret;
+        }
+    }
+    if (head - tail > ch->my_ring.mask + 1)
+    {
+        return -EIO;
+    }
+
+    // 2. 只写入放得下的部分 (短写)
+    n = mydevice_iter_to_ring(ch->my_ring.buf, ch->my_ring.mask, head,
+                              min_t(size_t, iov_iter_count(from), ch->my_ring.mask + 1 - (head - tail)), from);
+    if (!n)
+    {
+        return -EFAULT;
+    }
+
+    // 3. 发布 head, 缓冲区从空变为非空时才唤醒读者
+    smp_store_release(&ch->my_ring.ctrl->head, head + n);
+    smp_mb();
+    if (READ_ONCE(ch->my_ring.ctrl->tail) == head)
+    {
+        wake_up_interruptible(&ch->my_rq);
+    }
+    return n;
+}
+
+static ssize_t mydevice_bcast_read(struct file *file, struct iov_iter *to)
+{
+    struct mydevice_file *ctx = file->private_data;
+    struct mydevice_channel *ch = ctx->ch;
+    unsigned int head, n;
+    int ret;
+
+    for (;;)
+    {
+        // 1. 本读者的游标追上 head 时等待新数据
+        if (READ_ONCE(ch->my_bcast.head) == ctx->pos)
+        {
+            if (file->f_flags & O_NONBLOCK)
+            {
+                return -EAGAIN;
+            }
+            ret = wait_event_interruptible(ch->my_rq, READ_ONCE(ch->my_bcast.head) != ctx->pos);
+            if (ret)
+            {
+                return ret;
+            }
+        }
+
+        if (mutex_lock_interruptible(&ch->my_lock))
+        {
+            return -ERESTARTSYS;
+        }
+        head = ch->my_bcast.head;
+        if (head != ctx->pos)
+        {
+            break;
+        }
+        mutex_unlock(&ch->my_lock);
+    }
+
+    // 2. 落后太多, 数据已被覆盖
+    if (head - ctx->pos > ch->my_bcast.mask + 1)
+    {
+        ctx->pos = head - (ch->my_bcast.mask + 1);
+        mutex_unlock(&ch->my_lock);
+        return -EOVERFLOW;
+    }
+
+    // 3. 持锁拷贝, 防止写者同时覆盖正在读的数据
+    n = mydevice_ring_to_iter(ch->my_bcast.buf, ch->my_bcast.mask, ctx->pos,
+                              min_t(size_t, iov_iter_count(to), head - ctx->pos), to);
+    if (!n)
+    {
+        mutex_unlock(&ch->my_lock);
+        return -EFAULT;
+    }
+    ctx->pos += n;
+    mutex_unlock(&ch->my_lock);
+    return n;
+}
+
+static ssize_t mydevice_bcast_write(struct file *file, struct iov_iter *from)
+{
+    struct mydevice_channel *ch = mydevice_chan(file);
+    unsigned int n;
+
+    // 数据只拷贝一次进内核, 所有读者共享; 单次最多写满一个缓冲区
+    if (mutex_lock_interruptible(&ch->my_lock))
+    {
+        return -ERESTARTSYS;
+    }
+    n = mydevice_iter_to_ring(ch->my_bcast.buf, ch->my_bcast.mask, ch->my_bcast.head,
+                              min_t(size_t, iov_iter_count(from), ch->my_bcast.mask + 1), from);
+    if (!n)
+    {
+        mutex_unlock(&ch->my_lock);
+        return -EFAULT;
+    }
+    WRITE_ONCE(ch->my_bcast.head, ch->my_bcast.head + n);
+    mutex_unlock(&ch->my_lock);
+
+    wake_up_interruptible(&ch->my_rq);
+    return n;
+}
+
+// 环形缓冲区与内核内存之间的拷贝, 跨过末尾时分两段
+static void mydevice_pcpu_get(struct mydevice_pcpu *pc, unsigned int pos, void *dst, unsigned int n)
+{
+    unsigned int off = pos & pc->mask;
+    unsigned int first = min(n, pc->mask + 1 - off);
+
+    memcpy(dst, pc->buf + off, first);
+    memcpy((char *)dst + first, pc->buf, n - first);
+}
+
+static void mydevice_pcpu_put(struct mydevice_pcpu *pc, unsigned int pos, const void *src, unsigned int n)
+{
+    unsigned int off = pos & pc->mask;
+    unsigned int first = min(n, pc->mask + 1 - off);
+
+    memcpy(pc->buf + off, src, first);
+    memcpy(pc->buf, (const char *)src + first, n - first);
+}
+
+static inline bool mydevice_pcpu_has_data(struct mydevice_pcpu *pc)
+{
+    return smp_load_acquire(&pc->head) != READ_ONCE(pc->tail);
+}
+
+static bool mydevice_pcpu_empty(struct mydevice_channel *ch)
+{
+    int cpu;
+
+    for_each_possible_cpu(cpu)
+    {
+        if (mydevice_pcpu_has_data(per_cpu_ptr(ch->pcpu, cpu)))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 当前 CPU 的缓冲区能否放下 len 字节数据的记录
+static bool mydevice_pcpu_room(struct mydevice_channel *ch, size_t len)
+{
+    struct mydevice_pcpu *pc = per_cpu_ptr(ch->pcpu, raw_smp_processor_id());
+
+    return pc->mask + 1 - (READ_ONCE(pc->head) - smp_load_acquire(&pc->tail)) >= PCPU_HDR_LEN + len;
+}
+
+// 选出下一条要读的记录所在的 CPU, 调用者持有通道锁
+static int mydevice_pcpu_next(struct mydevice_channel *ch, struct mydevice_file *ctx)
+{
+    struct mydevice_pcpu_hdr hdr;
+    u64 best_ts = U64_MAX;
+    int cpu, best = -1;
+    unsigned int i;
+
+    if (ch->partial_cpu >= 0)
+    {
+        return ch->partial_cpu;
+    }
+
+    if (ctx->order == MYDEVICE_ORDER_TS)
+    {
+        for_each_possible_cpu(cpu)
+        {
+            struct mydevice_pcpu *pc = per_cpu_ptr(ch->pcpu, cpu);
+
+            if (!mydevice_pcpu_has_data(pc))
+            {
+                continue;
+            }
+            mydevice_pcpu_get(pc, pc->tail, &hdr, PCPU_HDR_LEN);
+            if (hdr.ts < best_ts)
+            {
+                best_ts = hdr.ts;
+                best = cpu;
+            }
+        }
+        return best;
+    }
+
+    cpu = ctx->rr_cpu;
+    for (i = 0; i < nr_cpu_ids; i++)
+    {
+        cpu = cpumask_next(cpu, cpu_possible_mask);
+        if (cpu >= nr_cpu_ids)
+        {
+            cpu = cpumask_first(cpu_possible_mask);
+        }
+        if (mydevice_pcpu_has_data(per_cpu_ptr(ch->pcpu, cpu)))
+        {
+            ctx->rr_cpu = cpu;
+            return cpu;
+        }
+    }
+    return -1;
+}
+
+static ssize_t mydevice_pcpu_read(struct file *file, struct iov_iter *to)
+{
+    struct mydevice_file *ctx = file->private_data;
+    struct mydevice_channel *ch = ctx->ch;
+    struct mydevice_pcpu_hdr hdr;
+    struct mydevice_pcpu *pc;
+    size_t copied, n;
+    bool freed;
+    int ret, cpu;
+
+    for (;;)
+    {
+        // 1. 所有 CPU 的缓冲区都为空时等待
+        if (mydevice_pcpu_empty(ch))
+        {
+            if (file->f_flags & O_NONBLOCK)
+            {
+                return -EAGAIN;
+            }
+            ret = wait_event_interruptible(ch->my_rq, !mydevice_pcpu_empty(ch));
+            if (ret)
+            {
+                return ret;
+            }
+        }
+
+        // 2. 按合并顺序逐条取记录, 直到用户缓冲区填满或全部取空
+        if (mutex_lock_interruptible(&ch->my_lock))
+        {
+            return -ERESTARTSYS;
+        }
+        copied = 0;
+        freed = false;
+        while (iov_iter_count(to) && (cpu = mydevice_pcpu_next(ch, ctx)) >= 0)
+        {
+            pc = per_cpu_ptr(ch->pcpu, cpu);
+            mydevice_pcpu_get(pc, pc->tail, &hdr, PCPU_HDR_LEN);
+            n = mydevice_ring_to_iter(pc->buf, pc->mask, pc->tail + PCPU_HDR_LEN + pc->rd_off,
+                                      min_t(size_t, iov_iter_count(to), hdr.len - pc->rd_off), to);
+            copied += n;
+            pc->rd_off += n;
+            if (pc->rd_off < hdr.len)
+            {
+                // 用户缓冲区已满或拷贝出错, 剩下的部分留给下一次读取
+                ch->partial_cpu = cpu;
+                if (!copied)
+                {
+                    mutex_unlock(&ch->my_lock);
+                    return -EFAULT;
+                }
+                break;
+            }
+
+            // 3. 整条记录读完才归还空间给写者
+            pc->rd_off = 0;
+            ch->partial_cpu = -1;
+            smp_store_release(&pc->tail, pc->tail + PCPU_HDR_LEN + hdr.len);
+            freed = true;
+        }
+        mutex_unlock(&ch->my_lock);
+
+        if (freed)
+        {
+            wake_up_interruptible(&ch->my_wq);
+        }
+        if (copied)
+        {
+            return copied;
+        }
+    }
+}
+
+static ssize_t mydevice_pcpu_write(struct file *file, struct iov_iter *from)
+{
+    struct mydevice_channel *ch = mydevice_chan(file);
+    size_t len = iov_iter_count(from);
+    struct mydevice_pcpu_hdr hdr;
+    struct mydevice_pcpu *pc;
+    unsigned int head;
+    int ret;
+
+    // 一次 write 是一条记录, 必须能整条放进一个 CPU 的缓冲区
+    if (len > per_cpu_ptr(ch->pcpu, raw_smp_processor_id())->mask + 1 - PCPU_HDR_LEN)
+    {
+        return -EMSGSIZE;
+    }
+
+    for (;;)
+    {
+        // 1. 只锁当前 CPU 的缓冲区; 睡眠后可能换了 CPU, 重新选择
+        pc = per_cpu_ptr(ch->pcpu, raw_smp_processor_id());
+        if (mutex_lock_interruptible(&pc->wlock))
+        {
+            return -ERESTARTSYS;
+        }
+        head = pc->head;
+        if (pc->mask + 1 - (head - smp_load_acquire(&pc->tail)) >= PCPU_HDR_LEN + len)
+        {
+            break;
+        }
+        mutex_unlock(&pc->wlock);
+
+        if (file->f_flags & O_NONBLOCK)
+        {
+            return -EAGAIN;
+        }
+        ret = wait_event_interruptible(ch->my_wq, mydevice_pcpu_room(ch, len));
+        if (ret)
+        {
+            return ret;
+        }
+    }
+
+    // 2. 写入记录头和数据
+    hdr.ts = ktime_get_ns();
+    hdr.len = len;
+    mydevice_pcpu_put(pc, head, &hdr, PCPU_HDR_LEN);
+    if (mydevice_iter_to_ring(pc->buf, pc->mask, head + PCPU_HDR_LEN, len, from) != len)
+    {
+        mutex_unlock(&pc->wlock);
+        return -EFAULT;
+    }
+
+    // 3. 发布整条记录, 本 CPU 缓冲区从空变为非空时唤醒读者
+    smp_store_release(&pc->head, head + PCPU_HDR_LEN + len);
+    mutex_unlock(&pc->wlock);
+    smp_mb();
+    if (READ_ONCE(pc->tail) == head)
+    {
+        wake_up_interruptible(&ch->my_rq);
+    }
+    return len;
+}
+
+/*
+ * 消息模式的可写条件: 放得下任意一条合法消息, 且空闲超过 tx_low.
+ * poll 和唤醒写者用同一个条件, 非阻塞写者被告知可写后不会再拿到 -EAGAIN.
+ */
+static bool mydevice_msg_room(struct mydevice_channel *ch)
+{
+    unsigned int avail = kfifo_avail(&ch->my_msgs);
+
+    return avail >= msg_max && avail > tx_low;
+}
+
+static ssize_t mydevice_msg_read(struct file *file, struct iov_iter *to)
 {
-    // 假设写入操作使设备变为可读
-    ready_to_read = 1;
-    pr_info("Data written, waking up readers...\n");
-    // 唤醒 my_rq 等待队列上的所有进程
-    wake_up_interruptible(&my_rq);
+    struct mydevice_channel *ch = mydevice_chan(file);
+    struct scatterlist sg[2];
+    unsigned int rec_len, nents;
+    size_t copied;
+    bool room;
+    int ret;
+
+    for (;;)
+    {
+        // 1. 没有消息时等待; 消息长度不一, 读者和写者都不用独占等待
+        if (kfifo_is_empty(&ch->my_msgs))
+        {
+            if (file->f_flags & O_NONBLOCK)
+            {
+                return -EAGAIN;
+            }
+            ret = wait_event_interruptible(ch->my_rq, !kfifo_is_empty(&ch->my_msgs));
+            if (ret)
+            {
+                return ret;
+            }
+        }
+
+        // 2. 连续取出放得下的整条消息, 一条消息绝不拆开
+        if (mutex_lock_interruptible(&ch->my_lock))
+        {
+            return -ERESTARTSYS;
+        }
+        copied = 0;
+        ret = 0;
+        room = mydevice_msg_room(ch);
+        while (!kfifo_is_empty(&ch->my_msgs))
+        {
+            rec_len = kfifo_peek_len(&ch->my_msgs);
+            if (rec_len > iov_iter_count(to))
+            {
+                // 第一条就放不下时报错, 否则留给下一次读取
+                ret = copied ? 0 : -EMSGSIZE;
+                break;
+            }
+            sg_init_table(sg, ARRAY_SIZE(sg));
+            nents = kfifo_dma_out_prepare(&ch->my_msgs, sg, ARRAY_SIZE(sg), rec_len);
+            if (mydevice_sg_to_iter(sg, nents, to) != rec_len)
+            {
+                // 拷贝出错时这条消息不出队, 已返回的字节数只算完整的消息
+                ret = copied ? 0 : -EFAULT;
+                break;
+            }
+            kfifo_dma_out_finish(&ch->my_msgs, rec_len);
+            ch->msg_count--;
+            ch->msg_bytes -= rec_len;
+            copied += rec_len;
+        }
+        // 只在跨过可写条件时唤醒; 写者的消息不超过 msg_max, 条件成立时都放得下
+        room = !room && mydevice_msg_room(ch);
+        mutex_unlock(&ch->my_lock);
+
+        if (ret)
+        {
+            return ret;
+        }
+        if (copied)
+        {
+            // 3. 写者等待的消息长度各不相同, 满足可写条件后全部唤醒由它们自己判断
+            if (room)
+            {
+                wake_up_interruptible(&ch->my_wq);
+            }
+            return copied;
+        }
+    }
+}
+
+static ssize_t mydevice_msg_write(struct file *file, struct iov_iter *from)
+{
+    struct mydevice_channel *ch = mydevice_chan(file);
+    size_t len = iov_iter_count(from);
+    struct scatterlist sg[2];
+    unsigned int nents, before;
+    int ret;
+
+    // writev 的各段合成一条消息, 长度不超过 msg_max (加载时已限制在 FIFO 容量内)
+    if (len > msg_max)
+    {
+        return -EMSGSIZE;
+    }
+
+    for (;;)
+    {
+        // 1. 等到整条消息放得下, 不做短写
+        if (kfifo_avail(&ch->my_msgs) < len)
+        {
+            if (file->f_flags & O_NONBLOCK)
+            {
+                return -EAGAIN;
+            }
+            ret = wait_event_interruptible(ch->my_wq, kfifo_avail(&ch->my_msgs) >= len);
+            if (ret)
+            {
+                return ret;
+            }
+        }
+
+        if (mutex_lock_interruptible(&ch->my_lock))
+        {
+            return -ERESTARTSYS;
+        }
+        if (kfifo_avail(&ch->my_msgs) >= len)
+        {
+            break;
+        }
+        mutex_unlock(&ch->my_lock);
+    }
+
+    // 2. 先拷数据, 完整拷贝后才写入长度前缀并入队
+    before = ch->msg_count;
+    sg_init_table(sg, ARRAY_SIZE(sg));
+    nents = kfifo_dma_in_prepare(&ch->my_msgs, sg, ARRAY_SIZE(sg), len);
+    if (mydevice_iter_to_sg(sg, nents, from) != len)
+    {
+        mutex_unlock(&ch->my_lock);
+        return -EFAULT;
+    }
+    kfifo_dma_in_finish(&ch->my_msgs, len);
+    ch->msg_count++;
+    ch->msg_bytes += len;
+    mutex_unlock(&ch->my_lock);
+
+    // 3. 队列从空变为非空时唤醒读者
+    if (!before)
+    {
+        wake_up_interruptible(&ch->my_rq);
+    }
     return len;
 }
 
+// read/readv/splice_read 都走这里, 每次调用尽量填满 iov_iter 的所有段
+static ssize_t mydevice_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+    struct file *file = iocb->ki_filp;
+    struct mydevice_channel *ch = mydevice_chan(file);
+    unsigned int copied, before, after, left;
+    int ret;
+
+    if (!iov_iter_count(to))
+    {
+        return 0;
+    }
+    if (spsc)
+    {
+        return mydevice_spsc_read(file, to);
+    }
+    if (broadcast)
+    {
+        return mydevice_bcast_read(file, to);
+    }
+    if (percpu)
+    {
+        return mydevice_pcpu_read(file, to);
+    }
+    if (message)
+    {
+        return mydevice_msg_read(file, to);
+    }
+
+    for (;;)
+    {
+        // 1. 非阻塞时有数据就读; 阻塞时睡眠直到数据达到 rx_low
+        if (file->f_flags & O_NONBLOCK)
+        {
+            if (kfifo_is_empty(&ch->my_fifo))
+            {
+                return -EAGAIN;
+            }
+        }
+        else
+        {
+            ret = wait_event_interruptible_exclusive(ch->my_rq, kfifo_len(&ch->my_fifo) >= rx_low);
+            if (ret)
+            {
+                return ret;
+            }
+        }
+
+        // 2. 出队到用户空间, 被其他读者抢先取空时重新等待
+        if (mutex_lock_interruptible(&ch->my_lock))
+        {
+            return -ERESTARTSYS;
+        }
+        before = kfifo_avail(&ch->my_fifo);
+        copied = mydevice_fifo_to_iter(&ch->my_fifo, to);
+        ret = (!copied && before != kfifo_size(&ch->my_fifo)) ? -EFAULT : 0;
+        after = kfifo_avail(&ch->my_fifo);
+        left = kfifo_len(&ch->my_fifo);
+        mutex_unlock(&ch->my_lock);
+        if (ret)
+        {
+            return ret;
+        }
+        if (copied)
+        {
+            break;
+        }
+    }
+
+    // 3. 空闲空间越过 tx_low 时才唤醒等待的写者
+    if (before <= tx_low && after > tx_low)
+    {
+        wake_up_interruptible(&ch->my_wq);
+    }
+    // 4. 读者是独占等待, 每次只唤醒一个; 剩余数据仍够时把唤醒传给下一个读者
+    if (left >= rx_low)
+    {
+        wake_up_interruptible(&ch->my_rq);
+    }
+    return copied;
+}
+
+// write/writev/splice_write 都走这里
+static ssize_t mydevice_write_iter(struct kiocb *iocb, struct iov_iter *from)
+{
+    struct file *file = iocb->ki_filp;
+    struct mydevice_channel *ch = mydevice_chan(file);
+    unsigned int copied, before, after, left;
+    int ret;
+
+    if (!iov_iter_count(from))
+    {
+        return 0;
+    }
+    if (spsc)
+    {
+        return mydevice_spsc_write(file, from);
+    }
+    if (broadcast)
+    {
+        return mydevice_bcast_write(file, from);
+    }
+    if (percpu)
+    {
+        return mydevice_pcpu_write(file, from);
+    }
+    if (message)
+    {
+        return mydevice_msg_write(file, from);
+    }
+
+    for (;;)
+    {
+        // 1. 非阻塞时有空间就写; 阻塞时睡眠直到空闲超过 tx_low
+        if (file->f_flags & O_NONBLOCK)
+        {
+            if (kfifo_is_full(&ch->my_fifo))
+            {
+                return -EAGAIN;
+            }
+        }
+        else
+        {
+            ret = wait_event_interruptible_exclusive(ch->my_wq, kfifo_avail(&ch->my_fifo) > tx_low);
+            if (ret)
+            {
+                return ret;
+            }
+        }
+
+        // 2. 尽量入队, 只写入放得下的部分 (短写)
+        if (mutex_lock_interruptible(&ch->my_lock))
+        {
+            return -ERESTARTSYS;
+        }
+        before = kfifo_len(&ch->my_fifo);
+        copied = mydevice_iter_to_fifo(&ch->my_fifo, from);
+        ret = (!copied && before != kfifo_size(&ch->my_fifo)) ? -EFAULT : 0;
+        after = kfifo_len(&ch->my_fifo);
+        left = kfifo_avail(&ch->my_fifo);
+        mutex_unlock(&ch->my_lock);
+        if (ret)
+        {
+            return ret;
+        }
+        if (copied)
+        {
+            break;
+        }
+    }
+
+    // 3. 数据量越过 rx_low 时才唤醒等待的读者
+    if (before < rx_low && after >= rx_low)
+    {
+        wake_up_interruptible(&ch->my_rq);
+    }
+    // 4. 写者同样是独占等待, 剩余空间仍够时把唤醒传给下一个写者
+    if (left > tx_low)
+    {
+        wake_up_interruptible(&ch->my_wq);
+    }
+    return copied;
+}
+
 static unsigned int mydevice_poll(struct file *file, struct poll_table_struct *wait)
 {
+    struct mydevice_channel *ch = mydevice_chan(file);
+    unsigned long events = poll_requested_events(wait);
     unsigned int reval_mask = 0;
-    poll_wait(file, &my_wq, wait);
-    poll_wait(file, &my_rq, wait);
 
-    if (ready_to_read)
+    // 只登记本文件的打开模式和调用者关心的事件所需的等待队列
+    if ((file->f_mode & FMODE_WRITE) && (events & (POLLOUT | POLLWRNORM)))
+    {
+        poll_wait(file, &ch->my_wq, wait);
+    }
+    if ((file->f_mode & FMODE_READ) && (events & (POLLIN | POLLRDNORM)))
+    {
+        poll_wait(file, &ch->my_rq, wait);
+    }
+
+    if (spsc)
+    {
+        unsigned int used;
+
+        // 与读写路径推进下标后的 smp_mb() 配对
+        smp_mb();
+        used = mydevice_spsc_used(ch);
+        if (used)
+        {
+            reval_mask |= (POLLIN | POLLRDNORM);
+        }
+        if (used != ch->my_ring.mask + 1)
+        {
+            reval_mask |= (POLLOUT | POLLWRNORM);
+        }
+        return reval_mask;
+    }
+
+    // 广播模式下写者从不阻塞, 每个读者按自己的游标判断是否可读
+    if (broadcast)
+    {
+        struct mydevice_file *ctx = file->private_data;
+
+        if (READ_ONCE(ch->my_bcast.head) != ctx->pos)
+        {
+            reval_mask |= (POLLIN | POLLRDNORM);
+        }
+        return reval_mask | POLLOUT | POLLWRNORM;
+    }
+
+    // 每 CPU 模式下任一 CPU 有数据即可读, 当前 CPU 的缓冲区有空间即可写
+    if (percpu)
+    {
+        smp_mb();
+        if (!mydevice_pcpu_empty(ch))
+        {
+            reval_mask |= (POLLIN | POLLRDNORM);
+        }
+        if (mydevice_pcpu_room(ch, 1))
+        {
+            reval_mask |= (POLLOUT | POLLWRNORM);
+        }
+        return reval_mask;
+    }
+
+    // 消息模式下有完整消息即可读, 放得下一条最大消息且空闲超过 tx_low 才可写
+    if (message)
+    {
+        if (!kfifo_is_empty(&ch->my_msgs))
+        {
+            reval_mask |= (POLLIN | POLLRDNORM);
+        }
+        if (mydevice_msg_room(ch))
+        {
+            reval_mask |= (POLLOUT | POLLWRNORM);
+        }
+        return reval_mask;
+    }
+
+    // 可读和可写按水位分别计算, 两者可同时成立
+    if (kfifo_len(&ch->my_fifo) >= rx_low)
     {
         reval_mask |= (POLLIN | POLLRDNORM);
     }
-    else if (ready_to_write)
+    if (kfifo_avail(&ch->my_fifo) > tx_low)
     {
         reval_mask |= (POLLOUT | POLLWRNORM);
     }
     return reval_mask;
 }
 
+// 用户空间直接读写映射的环形缓冲区, 只在跨越空/满边界时通过门铃唤醒对端
+static long mydevice_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+    struct mydevice_file *ctx = file->private_data;
+    struct mydevice_channel *ch = ctx->ch;
+    struct mydevice_queued queued;
+    int ret, order;
+
+    switch (cmd)
+    {
+    case MYDEVICE_GET_QUEUED:
+        if (!message)
+        {
+            return -ENOTTY;
+        }
+        if (mutex_lock_interruptible(&ch->my_lock))
+        {
+            return -ERESTARTSYS;
+        }
+        queued.messages = ch->msg_count;
+        queued.bytes = ch->msg_bytes;
+        mutex_unlock(&ch->my_lock);
+        return copy_to_user((void __user *)arg, &queued, sizeof(queued)) ? -EFAULT : 0;
+    case MYDEVICE_SET_ORDER:
+        if (!percpu)
+        {
+            return -ENOTTY;
+        }
+        if (get_user(order, (int __user *)arg))
+        {
+            return -EFAULT;
+        }
+        if (order != MYDEVICE_ORDER_RR && order != MYDEVICE_ORDER_TS)
+        {
+            return -EINVAL;
+        }
+        ctx->order = order;
+        return 0;
+    case MYDEVICE_RING_PRODUCED:
+        if (!spsc)
+        {
+            return -ENOTTY;
+        }
+        ret = mydevice_spsc_claim(file, SPSC_WRITER);
+        if (ret)
+        {
+            return ret;
+        }
+        smp_mb();
+        if (mydevice_spsc_used(ch))
+        {
+            wake_up_interruptible(&ch->my_rq);
+        }
+        return 0;
+    case MYDEVICE_RING_CONSUMED:
+        if (!spsc)
+        {
+            return -ENOTTY;
+        }
+        ret = mydevice_spsc_claim(file, SPSC_READER);
+        if (ret)
+        {
+            return ret;
+        }
+        smp_mb();
+        if (mydevice_spsc_used(ch) != ch->my_ring.mask + 1)
+        {
+            wake_up_interruptible(&ch->my_wq);
+        }
+        return 0;
+    default:
+        return -ENOTTY;
+    }
+}
+
+// 把控制页和数据区映射到用户空间, 只支持从偏移 0 开始映射
+static int mydevice_mmap(struct file *file, struct vm_area_struct *vma)
+{
+    struct mydevice_channel *ch = mydevice_chan(file);
+    if (!spsc)
+    {
+        return -ENODEV;
+    }
+    if (vma->vm_pgoff)
+    {
+        return -EINVAL;
+    }
+    return remap_vmalloc_range(vma, ch->my_ring.ctrl, 0);
+}
+
+/*
+ * 消息模式下不支持 splice, 以免破坏消息边界: 读取时管道可能只收下消息的一部分,
+ * 写入时 iter_file_splice_write 会把多个管道缓冲区合成一次 write_iter,
+ * 变成一条任意长度的消息
+ */
+static ssize_t mydevice_splice_read(struct file *in, loff_t *ppos, struct pipe_inode_info *pipe, size_t len,
+                                    unsigned int flags)
+{
+    if (message)
+    {
+        return -EINVAL;
+    }
+    return generic_file_splice_read(in, ppos, pipe, len, flags);
+}
+
+static ssize_t mydevice_splice_write(struct pipe_inode_info *pipe, struct file *out, loff_t *ppos, size_t len,
+                                     unsigned int flags)
+{
+    if (message)
+    {
+        return -EINVAL;
+    }
+    return iter_file_splice_write(pipe, out, ppos, len, flags);
+}
+
 static struct file_operations fops = {.owner = THIS_MODULE,
                                       .open = mydevice_open,
                                       .release = mydevice_release,
-                                      .read = mydevice_read,
-                                      .write = mydevice_write,
-                                      .poll = mydevice_poll};
+                                      .read_iter = mydevice_read_iter,
+                                      .write_iter = mydevice_write_iter,
+                                      .splice_read = mydevice_splice_read,
+                                      .splice_write = mydevice_splice_write,
+                                      .poll = mydevice_poll,
+                                      .unlocked_ioctl = mydevice_ioctl,
+                                      .mmap = mydevice_mmap,
+                                      .llseek = no_llseek};
+
+static void mydevice_pcpu_free(struct mydevice_channel *ch)
+{
+    int cpu;
+
+    if (!ch->pcpu)
+    {
+        return;
+    }
+    for_each_possible_cpu(cpu)
+    {
+        kfree(per_cpu_ptr(ch->pcpu, cpu)->buf);
+    }
+    free_percpu(ch->pcpu);
+}
+
+// 第 index 个通道所在的节点: 在线节点之间轮流分配
+static int mydevice_channel_node(unsigned int index)
+{
+    int node;
+
+    index %= num_online_nodes();
+    for_each_online_node(node)
+    {
+        if (!index--)
+        {
+            return node;
+        }
+    }
+    return NUMA_NO_NODE;
+}
+
+// 分配一个通道及其缓冲区, 各种环形模式都按 2 的幂取整
+static struct mydevice_channel *mydevice_channel_create(unsigned int index)
+{
+    int node = mydevice_channel_node(index);
+    struct mydevice_channel *ch;
+
+    ch = kzalloc_node(sizeof(*ch), GFP_KERNEL, node);
+    if (!ch)
+    {
+        return NULL;
+    }
+    mutex_init(&ch->my_lock);
+    init_waitqueue_head(&ch->my_wq);
+    init_waitqueue_head(&ch->my_rq);
+
+    if (broadcast)
+    {
+        ch->my_bcast.buf = kmalloc_node(roundup_pow_of_two(fifo_size), GFP_KERNEL, node);
+        if (!ch->my_bcast.buf)
+        {
+            goto err_free_channel;
+        }
+        ch->my_bcast.mask = roundup_pow_of_two(fifo_size) - 1;
+    }
+    else if (spsc)
+    {
+        // 控制页 + 整页的数据区, 清零后可安全映射给用户空间
+        unsigned int size = max_t(unsigned int, roundup_pow_of_two(fifo_size), PAGE_SIZE);
+
+        ch->my_ring.ctrl = vmalloc_user(PAGE_SIZE + size);
+        if (!ch->my_ring.ctrl)
+        {
+            goto err_free_channel;
+        }
+        ch->my_ring.buf = (char *)ch->my_ring.ctrl + PAGE_SIZE;
+        ch->my_ring.mask = size - 1;
+        ch->my_ring.ctrl->size = size;
+        ch->my_ring.ctrl->data_offset = PAGE_SIZE;
+    }
+    else if (percpu)
+    {
+        // 每个 CPU 的缓冲区放在该 CPU 所在的节点上
+        int cpu;
+
+        ch->partial_cpu = -1;
+        ch->pcpu = alloc_percpu(struct mydevice_pcpu);
+        if (!ch->pcpu)
+        {
+            goto err_free_channel;
+        }
+        for_each_possible_cpu(cpu)
+        {
+            struct mydevice_pcpu *pc = per_cpu_ptr(ch->pcpu, cpu);
+
+            mutex_init(&pc->wlock);
+            pc->buf = kmalloc_node(roundup_pow_of_two(fifo_size), GFP_KERNEL, cpu_to_node(cpu));
+            if (!pc->buf)
+            {
+                goto err_free_pcpu;
+            }
+            pc->mask = roundup_pow_of_two(fifo_size) - 1;
+        }
+    }
+    else
+    {
+        // kfifo_alloc 不能指定节点, 自己按节点分配后用 kfifo_init 接管
+        ch->fifo_buf = kmalloc_node(roundup_pow_of_two(fifo_size), GFP_KERNEL, node);
+        if (!ch->fifo_buf)
+        {
+            goto err_free_channel;
+        }
+        if (message)
+        {
+            kfifo_init(&ch->my_msgs, ch->fifo_buf, roundup_pow_of_two(fifo_size));
+        }
+        else
+        {
+            kfifo_init(&ch->my_fifo, ch->fifo_buf, roundup_pow_of_two(fifo_size));
+        }
+    }
+    return ch;
+
+err_free_pcpu:
+    mydevice_pcpu_free(ch);
+err_free_channel:
+    kfree(ch);
+    return NULL;
+}
+
+static void mydevice_channel_destroy(struct mydevice_channel *ch)
+{
+    if (!ch)
+    {
+        return;
+    }
+    kfree(ch->my_bcast.buf);
+    vfree(ch->my_ring.ctrl);
+    mydevice_pcpu_free(ch);
+    kfree(ch->fifo_buf);
+    kfree(ch);
+}
+
+static void mydevice_destroy_channels(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < nr_channels; i++)
+    {
+        mydevice_channel_destroy(channels[i]);
+    }
+    kfree(channels);
+}
 
 static int __init mydevice_init(void)
 {
+    struct device *device;
     dev_t dev = 0;
+    unsigned int i;
+    int ret;
+
+    // 0. 检查参数并分配各通道
+    if (!fifo_size || fifo_size > (1U << 30) || spsc + broadcast + percpu + message > 1 ||
+        !nr_channels || nr_channels > MYDEVICE_MAX_CHANNELS || (percpu && fifo_size <= PCPU_HDR_LEN) ||
+        (message && fifo_size <= sizeof(u16)))
+    {
+        return -EINVAL;
+    }
+    // 水位限制在 FIFO 容量内, 否则读者或写者永远等不到
+    rx_low = clamp_t(unsigned int, rx_low, 1, roundup_pow_of_two(fifo_size));
+    tx_low = min_t(unsigned int, tx_low, roundup_pow_of_two(fifo_size) - 1);
+    if (message)
+    {
+        // 消息上限和水位都受 2 字节长度前缀和 FIFO 容量限制, 空 FIFO 必须满足可写条件
+        i = min_t(unsigned int, roundup_pow_of_two(fifo_size) - sizeof(u16), U16_MAX);
+        msg_max = clamp_t(unsigned int, msg_max, 1, i);
+        tx_low = min_t(unsigned int, tx_low, i - 1);
+    }
 
-    // 1. 分配设备号
-    if (alloc_chrdev_region(&dev, 0, 1, DEVICE_NAME) < 0)
+    channels = kcalloc(nr_channels, sizeof(*channels), GFP_KERNEL);
+    if (!channels)
+    {
+        return -ENOMEM;
+    }
+    for (i = 0; i < nr_channels; i++)
     {
-        return -1;
+        channels[i] = mydevice_channel_create(i);
+        if (!channels[i])
+        {
+            ret = -ENOMEM;
+            goto err_free_channels;
+        }
+    }
+
+    // 1. 分配设备号, 每个通道一个次设备号
+    ret = alloc_chrdev_region(&dev, 0, nr_channels, DEVICE_NAME);
+    if (ret < 0)
+    {
+        goto err_free_channels;
     }
     major = MAJOR(dev);
 
     // 2. 初始化并添加字符设备
     cdev_init(&mycdev, &fops);
     mycdev.owner = THIS_MODULE;
-    if (cdev_add(&mycdev, dev, 1) < 0)
+    ret = cdev_add(&mycdev, dev, nr_channels);
+    if (ret < 0)
     {
-        unregister_chrdev_region(dev, 1);
-        return -1;
+        goto err_unregister_dev;
     }
 
     // 3. 创建设备类
     myclass = class_create(THIS_MODULE, CLASS_NAME);
     if (IS_ERR(myclass))
     {
-        cdev_del(&mycdev);
-        unregister_chrdev_region(dev, 1);
-        return PTR_ERR(myclass);
+        ret = PTR_ERR(myclass);
+        goto err_cdev_del;
     }
 
-    // 4. 创建设备节点
-    device_create(myclass, NULL, dev, NULL, DEVICE_NAME);
+    // 4. 创建设备节点 /dev/mydevice0..N-1
+    for (i = 0; i < nr_channels; i++)
+    {
+        device = device_create(myclass, NULL, MKDEV(major, i), NULL, DEVICE_NAME "%u", i);
+        if (IS_ERR(device))
+        {
+            ret = PTR_ERR(device);
+            goto err_device_destroy;
+        }
+    }
 
-    pr_info("My device driver loaded\n");
+    pr_info("My device driver loaded, %u channels, %s %u bytes\n", nr_channels,
+            spsc        ? "spsc ring"
+            : broadcast ? "broadcast ring"
+            : percpu    ? "per-cpu rings"
+            : message   ? "message fifo"
+                        : "fifo",
+            (unsigned int)roundup_pow_of_two(fifo_size));
     return 0;
+
+err_device_destroy:
+    while (i--)
+    {
+        device_destroy(myclass, MKDEV(major, i));
+    }
+    class_destroy(myclass);
+err_cdev_del:
+    cdev_del(&mycdev);
+err_unregister_dev:
+    unregister_chrdev_region(dev, nr_channels);
+err_free_channels:
+    mydevice_destroy_channels();
+    return ret;
 }
 
 static void __exit mydevice_exit(void)
 {
     dev_t dev = MKDEV(major, 0);
+    unsigned int i;
 
     // 1. 销毁设备节点
-    device_destroy(myclass, dev);
+    for (i = 0; i < nr_channels; i++)
+    {
+        device_destroy(myclass, MKDEV(major, i));
+    }
 
     // 2. 销毁设备类
     class_destroy(myclass);
@@ -123,7 +1533,10 @@ static void __exit mydevice_exit(void)
     cdev_del(&mycdev);
 
     // 4. 释放设备号
-    unregister_chrdev_region(dev, 1);
+    unregister_chrdev_region(dev, nr_channels);
+
+    // 5. 释放各通道
+    mydevice_destroy_channels();
 
     pr_info("My device driver unloaded\n");
 }
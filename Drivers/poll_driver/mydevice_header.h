@@ -0,0 +1,54 @@
+#ifndef __MYDEVICE_HEADER_H__
+#define __MYDEVICE_HEADER_H__
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+#define MYDEVICE_MAGIC 'M'
+#define MYDEVICE_RING_PRODUCED_NO 0x01
+#define MYDEVICE_RING_CONSUMED_NO 0x02
+#define MYDEVICE_SET_ORDER_NO 0x03
+#define MYDEVICE_GET_QUEUED_NO 0x04
+
+// 控制页中 head 和 tail 各占一个缓存行, 避免生产者和消费者互相抢缓存行
+#define MYDEVICE_CACHELINE 64
+
+/*
+ * spsc=1 时 mmap(fd, 偏移 0) 得到: [控制页][数据区 size 字节]
+ * 生产者写入数据后以 release 语义推进 head, 消费者处理完后以 release 语义推进 tail,
+ * 读取对方下标用 acquire 语义; 下标自由增长, 取模 size 得到数据区偏移.
+ */
+struct mydevice_ring_ctrl
+{
+    __u32 head; // 生产者推进
+    __u8 pad0[MYDEVICE_CACHELINE - sizeof(__u32)];
+    __u32 tail; // 消费者推进
+    __u8 pad1[MYDEVICE_CACHELINE - sizeof(__u32)];
+    __u32 size;        // 数据区字节数, 2 的幂, 只读
+    __u32 data_offset; // 数据区相对映射起点的偏移, 只读
+};
+
+/*
+ * 门铃: 只在跨越空/满边界时需要系统调用
+ * 生产者推进 head 并执行全屏障后, 若 tail 等于推进前的 head (原来为空), 调用 PRODUCED 唤醒读者;
+ * 消费者推进 tail 并执行全屏障后, 若 head - 推进前的 tail 等于 size (原来已满), 调用 CONSUMED 唤醒写者.
+ * 等待用 poll(): POLLIN 表示非空, POLLOUT 表示非满.
+ */
+#define MYDEVICE_RING_PRODUCED _IO(MYDEVICE_MAGIC, MYDEVICE_RING_PRODUCED_NO)
+#define MYDEVICE_RING_CONSUMED _IO(MYDEVICE_MAGIC, MYDEVICE_RING_CONSUMED_NO)
+
+// percpu=1 时读取合并各 CPU 缓冲区的顺序, 对本次打开的文件生效
+#define MYDEVICE_ORDER_RR 0 // 各 CPU 轮流取一条记录 (默认)
+#define MYDEVICE_ORDER_TS 1 // 按写入时间戳取最早的记录
+#define MYDEVICE_SET_ORDER _IOW(MYDEVICE_MAGIC, MYDEVICE_SET_ORDER_NO, int)
+
+// message=1 时队列中的消息条数和数据字节数 (不含长度前缀)
+struct mydevice_queued
+{
+    __u32 messages;
+    __u32 bytes;
+};
+
+#define MYDEVICE_GET_QUEUED _IOR(MYDEVICE_MAGIC, MYDEVICE_GET_QUEUED_NO, struct mydevice_queued)
+
+#endif